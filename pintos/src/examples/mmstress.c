@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+#define PAGES 320
+#define MAP ((char *) 0x10000000)
+
+static char buf[4096];
+
+int
+main (int argc, char *argv[])
+{
+  int fd, i, pass;
+  mapid_t m;
+
+  if (argc == 1)
+    {
+      pid_t a, b;
+      int bad = 0;
+
+      if (!create ("big", PAGES * 4096))
+        return 1;
+      a = exec ("mmstress 0");
+      b = exec ("mmstress 1");
+      printf ("mmstress: children %d %d\n", wait (a), wait (b));
+      fd = open ("big");
+      for (i = 0; i < PAGES; i++)
+        {
+          read (fd, buf, 4096);
+          if (buf[0] != (char) (i + 1) || buf[4095] != (char) (i + 1))
+            bad++;
+        }
+      printf ("mmstress: %d bad pages\n", bad);
+      return bad;
+    }
+
+  fd = open ("big");
+  m = mmap (fd, MAP);
+  if (m == MAP_FAILED)
+    return 2;
+  for (pass = 0; pass < 3; pass++)
+    for (i = argv[1][0] - '0'; i < PAGES; i += 2)
+      {
+        MAP[i * 4096] = i + 1;
+        MAP[i * 4096 + 4095] = i + 1;
+      }
+  munmap (m);
+  return 0;
+}
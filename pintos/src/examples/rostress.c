@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+#define SIZE (1536 * 1024)
+static const unsigned char ro[SIZE] = {1, 2, 3};
+static unsigned char rw[512 * 1024] = {1};
+
+int
+main (int argc, char *argv[])
+{
+  unsigned sum = 0;
+  size_t i;
+  int pass;
+
+  if (argc == 1)
+    {
+      pid_t a = exec ("rostress x"), b = exec ("rostress x");
+      int ra = wait (a), rb = wait (b);
+      printf ("rostress: children %d %d\n", ra, rb);
+      return 0;
+    }
+  for (pass = 0; pass < 3; pass++)
+    for (i = 0; i < SIZE; i += 4096)
+      {
+        sum += ro[i];
+        rw[(i / 3) % sizeof rw] = sum;
+      }
+  return sum == 18 ? 0 : 100 + sum;
+}
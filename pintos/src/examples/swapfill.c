@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+#define SIZE (6 * 1024 * 1024)
+static char buf[SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  if (argc > 1)
+    {
+      int i, bad = 0;
+      for (i = 0; i < SIZE; i += 4096)
+        buf[i] = i / 4096 + 1;
+      for (i = 0; i < SIZE; i += 4096)
+        bad += buf[i] != (char) (i / 4096 + 1);
+      printf ("child: %d bad\n", bad);
+      return 0;
+    }
+  printf ("swapfill: child 1 exit %d\n", wait (exec ("swapfill x")));
+  printf ("swapfill: child 2 exit %d\n", wait (exec ("swapfill x")));
+  return 0;
+}
@@ -4,6 +4,7 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -20,11 +21,83 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Timer wheel, holding the pending callback timers.
+
+   A timer due in fewer than WHEEL_ROOT_SIZE ticks goes into the
+   root wheel, in the slot for the tick it expires, so that each
+   tick fires exactly the timers in one slot.  Timers due later go
+   into one of the outer wheels, whose slots each cover a range of
+   ticks that grows by a factor of WHEEL_SIZE per level.  Whenever
+   the root wheel comes around to slot 0, the timers in the next
+   slot of the first outer wheel are redistributed to the root
+   wheel, and likewise for each outer wheel as it comes around.
+
+   Adding or canceling a timer takes constant time, and each tick
+   does work proportional to the number of timers that expire,
+   plus the occasional redistribution. */
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_ROOT_SIZE (1 << WHEEL_ROOT_BITS)
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_OUTER_CNT 3
+
+/* Timers due further out than this are held back at this
+   distance until they come closer. */
+#define WHEEL_MAX_DELTA \
+  ((int64_t) 1 << (WHEEL_ROOT_BITS + WHEEL_OUTER_CNT * WHEEL_BITS))
+
+static struct list wheel_root[WHEEL_ROOT_SIZE];
+static struct list wheel_outer[WHEEL_OUTER_CNT][WHEEL_SIZE];
+static int64_t wheel_ticks;     /* Next tick the wheel must process. */
+
+/* Clock source and clock events.
+
+   Once timer_calibrate() has measured the CPU's time-stamp
+   counter against the PIT, the TSC becomes the clock, and the PIT
+   no longer runs periodically.  Instead, each timer interrupt
+   arms it in one-shot mode for the next event: the next tick or,
+   if sooner, the next high-resolution timer.  Tick N is due when
+   the TSC reaches tsc_base + N * tsc_per_tick, so the tick count
+   does not drift however late an interrupt is taken.
+
+   While the CPU is idle, timer_stop_tick() arms the PIT for the
+   next tick at which the wheel has work to do, skipping the
+   ticks in between.  The first interrupt of any kind to arrive
+   afterward accounts for the skipped ticks in one go.  The PIT
+   cannot count much past 55 ms, which bounds the skip. */
+static bool oneshot;            /* Using one-shot clock events? */
+static bool tick_stopped;       /* Tick stopped by idle thread? */
+static uint64_t tsc_hz;         /* TSC cycles per second. */
+static uint64_t tsc_per_tick;   /* TSC cycles per timer tick. */
+static uint64_t tsc_base;       /* TSC value when tick 0 was due. */
+static uint64_t next_tick_tsc;  /* TSC value when next tick is due. */
+static uint64_t oneshot_max;    /* Longest PIT interval in TSC cycles. */
+
+/* Number of ticks over which to measure the TSC's frequency. */
+#define TSC_CALIBRATE_TICKS 8
+
+/* High-resolution timers, for sleeps shorter than a tick, in
+   order of expiration.  Their `expires' members hold TSC values
+   rather than ticks. */
+static struct list hr_timers;
+
+/* Number of timer interrupts taken. */
+static long long intr_cnt;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static void tick (void);
+static void catch_up (void);
+static void program_event (void);
+static void calibrate_tsc (void);
+static list_less_func hr_timer_less;
+static void wheel_insert (struct timer *);
+static void wheel_advance (void);
+static int64_t wheel_next_work (int64_t limit);
+static timer_func wake_thread;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,11 +108,22 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  size_t i, j;
+
+  for (i = 0; i < WHEEL_ROOT_SIZE; i++)
+    list_init (&wheel_root[i]);
+  for (i = 0; i < WHEEL_OUTER_CNT; i++)
+    for (j = 0; j < WHEEL_SIZE; j++)
+      list_init (&wheel_outer[i][j]);
+  list_init (&hr_timers);
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays.
+   Then, if the CPU has a time-stamp counter, calibrates it and
+   switches to one-shot clock events. */
 void
 timer_calibrate (void) 
 {
@@ -64,6 +148,41 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  if (cpu_has_features (CPUID_TSC))
+    calibrate_tsc ();
+}
+
+/* Measures the TSC's frequency against the periodic PIT, then
+   makes the TSC the clock and switches the PIT to one-shot
+   mode. */
+static void
+calibrate_tsc (void)
+{
+  enum intr_level old_level;
+  int64_t start, end;
+  uint64_t start_tsc;
+
+  /* Measure from one tick to another. */
+  end = timer_ticks ();
+  while ((start = timer_ticks ()) == end)
+    barrier ();
+  start_tsc = rdtsc ();
+  end = start + TSC_CALIBRATE_TICKS;
+  while (timer_ticks () < end)
+    barrier ();
+  tsc_per_tick = (rdtsc () - start_tsc) / TSC_CALIBRATE_TICKS;
+  tsc_hz = tsc_per_tick * TIMER_FREQ;
+  oneshot_max = tsc_hz * 65535 / PIT_HZ;
+
+  old_level = intr_disable ();
+  tsc_base = start_tsc - (uint64_t) start * tsc_per_tick;
+  next_tick_tsc = tsc_base + (uint64_t) (ticks + 1) * tsc_per_tick;
+  oneshot = true;
+  program_event ();
+  intr_set_level (old_level);
+
+  printf ("Using %'"PRIu64" Hz TSC as clock.\n", tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -84,22 +203,140 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of nanoseconds since the OS booted.  Once
+   the timer has been calibrated, the result has the resolution
+   of the CPU's time-stamp counter; before then, that of a tick. */
+int64_t
+timer_ns (void)
+{
+  uint64_t cycles;
+
+  if (!oneshot)
+    return timer_ticks () * (1000000000 / TIMER_FREQ);
+  cycles = rdtsc () - tsc_base;
+  return (cycles / tsc_hz * 1000000000
+          + cycles % tsc_hz * 1000000000 / tsc_hz);
+}
+
+/* Initializes TIMER to call FUNC, passing AUX, when it fires. */
+void
+timer_setup (struct timer *timer, timer_func *func, void *aux)
+{
+  timer->func = func;
+  timer->aux = aux;
+  timer->pending = false;
+}
+
+/* Starts TIMER so that it fires TICKS timer ticks from now, or
+   at the next tick if TICKS is not positive.  If TIMER is already
+   pending, it is moved to the new time.
+
+   TIMER's function is called from the timer interrupt handler,
+   so it must be quick and must not sleep.  It may add timers,
+   including TIMER itself.  TIMER must stay in memory until it has
+   fired or been canceled.
+
+   This function may be called from an interrupt handler. */
+void
+timer_add (struct timer *timer, int64_t ticks)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (timer->pending)
+    list_remove (&timer->elem);
+  timer->expires = timer_ticks () + (ticks > 0 ? ticks : 1);
+  timer->pending = true;
+  wheel_insert (timer);
+  intr_set_level (old_level);
+}
+
+/* Stops TIMER from firing.  Returns true if TIMER was pending,
+   false if it had already fired or was never added.
+
+   This function may be called from an interrupt handler. */
+bool
+timer_cancel (struct timer *timer)
+{
+  enum intr_level old_level = intr_disable ();
+  bool was_pending = timer->pending;
+
+  if (was_pending)
+    {
+      list_remove (&timer->elem);
+      timer->pending = false;
+    }
+  intr_set_level (old_level);
+  return was_pending;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
-timer_sleep (int64_t ticks) 
+timer_sleep (int64_t ticks)
 {
+  struct timer timer;
+  enum intr_level old_level;
+
   ASSERT (intr_get_level () == INTR_ON);
   if (ticks <= 0)
+    return;
+
+  timer_setup (&timer, wake_thread, thread_current ());
+  old_level = intr_disable ();
+  timer_add (&timer, ticks);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Timer function for timer_sleep() and real_time_sleep(). */
+static void
+wake_thread (void *thread)
+{
+  thread_unblock (thread);
+}
+
+/* Returns true if high-resolution timer A_ expires before B_. */
+static bool
+hr_timer_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct timer *a = list_entry (a_, struct timer, elem);
+  const struct timer *b = list_entry (b_, struct timer, elem);
+
+  return a->expires < b->expires;
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  Stops the timer tick until the wheel next has
+   work to do, so that an idle CPU is not woken every tick for
+   nothing. */
+void
+timer_stop_tick (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot)
     {
-      return;
+      tick_stopped = true;
+      program_event ();
+    }
+}
+
+/* Called on entry to every external interrupt.  If the idle
+   thread stopped the tick, processes the ticks skipped since
+   then and restarts the tick, so that the interrupt's handler
+   sees the current time. */
+void
+timer_resume_tick (void)
+{
+  ASSERT (intr_context ());
+
+  if (tick_stopped)
+    {
+      tick_stopped = false;
+      catch_up ();
+      program_event ();
     }
-  enum intr_level old_level = intr_disable ();
-  thread_current()->ticks = timer_ticks() + ticks;
-  list_insert_ordered(&sleep_list, &thread_current()->elem,
-		      (list_less_func *) &cmp_ticks, NULL);
-  thread_block();
-  intr_set_level(old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -169,27 +406,190 @@ timer_ndelay (int64_t ns)
 void
 timer_print_stats (void) 
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %lld interrupts\n",
+          timer_ticks (), intr_cnt);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
+{
+  intr_cnt++;
+  if (!oneshot)
+    tick ();
+  else
+    {
+      catch_up ();
+      while (!list_empty (&hr_timers))
+        {
+          struct timer *timer = list_entry (list_front (&hr_timers),
+                                            struct timer, elem);
+          if ((uint64_t) timer->expires > rdtsc ())
+            break;
+          list_pop_front (&hr_timers);
+          timer->pending = false;
+          timer->func (timer->aux);
+        }
+      program_event ();
+    }
+  thread_preempt ();
+}
+
+/* Advances the time by one tick. */
+static void
+tick (void)
 {
   ticks++;
+  while (wheel_ticks <= ticks)
+    wheel_advance ();
   thread_tick ();
+}
+
+/* Processes every tick that the TSC says has come due. */
+static void
+catch_up (void)
+{
+  uint64_t now = rdtsc ();
 
-  struct list_elem *e = list_begin(&sleep_list);
-  while (e != list_end(&sleep_list))
+  while (now >= next_tick_tsc)
     {
-      struct thread *t = list_entry(e, struct thread, elem);      
-      if (ticks < t->ticks)
-	{
-	  break;
-	}
-      list_remove(e);
-      thread_unblock(t);
-      e = list_begin(&sleep_list);
+      next_tick_tsc += tsc_per_tick;
+      tick ();
+    }
+}
+
+/* Arms the PIT for the next clock event: the next tick or, if
+   the tick is stopped, the next tick at which the wheel has work
+   to do, or the first high-resolution timer if that is sooner.
+   Interrupts must be off. */
+static void
+program_event (void)
+{
+  uint64_t next = next_tick_tsc;
+  uint64_t now, delta;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tick_stopped)
+    {
+      int64_t limit = wheel_ticks + oneshot_max / tsc_per_tick + 1;
+      next = tsc_base + (uint64_t) wheel_next_work (limit) * tsc_per_tick;
+    }
+  if (!list_empty (&hr_timers))
+    {
+      struct timer *timer = list_entry (list_front (&hr_timers),
+                                        struct timer, elem);
+      if ((uint64_t) timer->expires < next)
+        next = timer->expires;
+    }
+
+  now = rdtsc ();
+  delta = next > now ? next - now : 0;
+  if (delta > oneshot_max)
+    delta = oneshot_max;
+  delta = DIV_ROUND_UP (delta * PIT_HZ, tsc_hz);
+  pit_oneshot (0, delta > 0 ? delta : 1);
+}
+
+/* Puts pending TIMER into the timer wheel slot for its expiration
+   time.  Interrupts must be off. */
+static void
+wheel_insert (struct timer *timer)
+{
+  int64_t expires = timer->expires;
+  int64_t delta = expires - wheel_ticks;
+  struct list *slot;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < WHEEL_ROOT_SIZE)
+    {
+      /* A timer already due fires at the next tick processed. */
+      if (delta < 0)
+        expires = wheel_ticks;
+      slot = &wheel_root[expires & (WHEEL_ROOT_SIZE - 1)];
+    }
+  else
+    {
+      int level = 0;
+      int shift = WHEEL_ROOT_BITS;
+
+      if (delta >= WHEEL_MAX_DELTA)
+        expires = wheel_ticks + WHEEL_MAX_DELTA - 1;
+      while (level < WHEEL_OUTER_CNT - 1
+             && delta >= (int64_t) 1 << (shift + WHEEL_BITS))
+        {
+          level++;
+          shift += WHEEL_BITS;
+        }
+      slot = &wheel_outer[level][(expires >> shift) & (WHEEL_SIZE - 1)];
+    }
+  list_push_back (slot, &timer->elem);
+}
+
+/* Returns the first tick, but no later than LIMIT, at which the
+   wheel has work to do: timers to fire, or a redistribution.
+   Interrupts must be off. */
+static int64_t
+wheel_next_work (int64_t limit)
+{
+  int64_t t;
+
+  for (t = wheel_ticks; t < limit; t++)
+    {
+      size_t idx = t & (WHEEL_ROOT_SIZE - 1);
+      if (idx == 0 || !list_empty (&wheel_root[idx]))
+        break;
+    }
+  return t;
+}
+
+/* Moves all of the timers in SLOT onto list TIMERS, which must be
+   empty. */
+static void
+take_slot (struct list *slot, struct list *timers)
+{
+  list_init (timers);
+  if (!list_empty (slot))
+    list_splice (list_end (timers), list_begin (slot), list_end (slot));
+}
+
+/* Fires the timers due at wheel_ticks, then advances wheel_ticks
+   by one tick.  Interrupts must be off. */
+static void
+wheel_advance (void)
+{
+  size_t idx = wheel_ticks & (WHEEL_ROOT_SIZE - 1);
+  struct list timers;
+
+  /* Each time a wheel comes around, refill it from the next. */
+  if (idx == 0)
+    {
+      int level, shift = WHEEL_ROOT_BITS;
+
+      for (level = 0; level < WHEEL_OUTER_CNT; level++, shift += WHEEL_BITS)
+        {
+          size_t outer_idx = (wheel_ticks >> shift) & (WHEEL_SIZE - 1);
+
+          take_slot (&wheel_outer[level][outer_idx], &timers);
+          while (!list_empty (&timers))
+            wheel_insert (list_entry (list_pop_front (&timers),
+                                      struct timer, elem));
+          if (outer_idx != 0)
+            break;
+        }
+    }
+
+  /* Take the expired timers out of the wheel before calling any
+     of them, because they may add timers. */
+  take_slot (&wheel_root[idx], &timers);
+  wheel_ticks++;
+  while (!list_empty (&timers))
+    {
+      struct timer *timer = list_entry (list_pop_front (&timers),
+                                        struct timer, elem);
+      timer->pending = false;
+      timer->func (timer->aux);
     }
 }
 
@@ -246,10 +646,26 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
+  else if (oneshot)
+    {
+      /* Otherwise, sleep on a high-resolution timer, which gets a
+         one-shot interrupt of its own at the exact time. */
+      struct timer timer;
+      enum intr_level old_level;
+
+      timer_setup (&timer, wake_thread, thread_current ());
+      old_level = intr_disable ();
+      timer.expires = rdtsc () + num * tsc_hz / denom;
+      timer.pending = true;
+      list_insert_ordered (&hr_timers, &timer.elem, hr_timer_less, NULL);
+      program_event ();
+      thread_block ();
+      intr_set_level (old_level);
+    }
   else 
     {
-      /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
+      /* Without a calibrated TSC, use a busy-wait loop for more
+         accurate sub-tick timing. */
       real_time_delay (num, denom); 
     }
 }
@@ -1,17 +1,39 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Function called when a callback timer fires. */
+typedef void timer_func (void *aux);
+
+/* A callback timer.  Set up with timer_setup(), then started
+   with timer_add(). */
+struct timer
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t expires;            /* Tick at which to fire. */
+    timer_func *func;           /* Function to call. */
+    void *aux;                  /* Argument for FUNC. */
+    bool pending;               /* Added but not yet fired or canceled? */
+  };
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_ns (void);
+
+/* Callback timers. */
+void timer_setup (struct timer *, timer_func *, void *aux);
+void timer_add (struct timer *, int64_t ticks);
+bool timer_cancel (struct timer *);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
@@ -24,6 +46,10 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_stop_tick (void);
+void timer_resume_tick (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
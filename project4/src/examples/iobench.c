@@ -0,0 +1,155 @@
+/* iobench.c
+
+   Measures I/O ring throughput by opening, reading, and closing
+   every file named on the command line, first with one trap per
+   request and then with one trap per batch of requests.
+
+   Output goes through the ring too, so this program needs no
+   system calls beyond the ring and exit. */
+
+#include <ring.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Number of times each file set is processed. */
+#define ROUNDS 16
+
+/* Bytes read from each file. */
+#define READ_SIZE 512
+
+/* Maximum number of files. */
+#define MAX_FILES 32
+
+static struct ioring ring;
+static char buffers[MAX_FILES][READ_SIZE];
+static int fds[MAX_FILES];
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Queues one request, with USER_DATA identifying it. */
+static void
+queue (enum ioring_op op, int fd, void *addr, uint32_t len,
+       uint32_t user_data)
+{
+  struct ioring_sqe sqe;
+
+  sqe.opcode = op;
+  sqe.fd = fd;
+  sqe.addr = addr;
+  sqe.len = len;
+  sqe.offset = 0;
+  sqe.user_data = user_data;
+  while (!ioring_queue (&ring, &sqe))
+    ioring_enter (1);
+}
+
+/* Waits for CNT completions and stores their results into
+   RESULTS, indexed by user data. */
+static void
+complete (int cnt, int *results)
+{
+  while (cnt > 0)
+    {
+      struct ioring_cqe cqe;
+
+      ioring_enter (1);
+      while (cnt > 0 && ioring_reap (&ring, &cqe))
+        {
+          if (results != NULL)
+            results[cqe.user_data] = cqe.res;
+          cnt--;
+        }
+    }
+}
+
+/* Prints a message through the ring. */
+static void
+say (const char *format, ...)
+{
+  static char msg[128];
+  va_list args;
+
+  va_start (args, format);
+  vsnprintf (msg, sizeof msg, format, args);
+  va_end (args);
+
+  queue (IORING_OP_WRITE, STDOUT_FILENO, msg, strlen (msg), 0);
+  complete (1, NULL);
+}
+
+/* Runs one open/pread/close pass over the FILE_CNT files in
+   FILES, submitting BATCH requests per trap.  Returns false if a
+   file could not be opened or read. */
+static bool
+run_pass (char **files, int file_cnt, int batch)
+{
+  int results[MAX_FILES];
+  int stage, i;
+
+  for (stage = 0; stage < 3; stage++)
+    {
+      int queued = 0;
+
+      for (i = 0; i < file_cnt; i++)
+        {
+          if (stage == 0)
+            queue (IORING_OP_OPEN, 0, files[i], 0, i);
+          else if (stage == 1)
+            queue (IORING_OP_PREAD, fds[i], buffers[i], READ_SIZE, i);
+          else
+            queue (IORING_OP_CLOSE, fds[i], NULL, 0, i);
+
+          if (++queued == batch)
+            {
+              complete (queued, results);
+              queued = 0;
+            }
+        }
+      complete (queued, results);
+
+      for (i = 0; i < file_cnt; i++)
+        {
+          if (results[i] < 0)
+            return false;
+          if (stage == 0)
+            fds[i] = results[i];
+        }
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const int batches[] = {1, 4, 16, MAX_FILES};
+  int file_cnt = argc - 1;
+  size_t b;
+
+  if (file_cnt < 1 || file_cnt > MAX_FILES || ioring_setup (&ring) < 0)
+    return 1;
+
+  for (b = 0; b < sizeof batches / sizeof *batches; b++)
+    {
+      uint64_t start = rdtsc ();
+      int round;
+
+      for (round = 0; round < ROUNDS; round++)
+        if (!run_pass (argv + 1, file_cnt, batches[b]))
+          {
+            say ("iobench: pass failed\n");
+            return 1;
+          }
+      say ("iobench: batch %2d: %llu cycles per file\n", batches[b],
+           (rdtsc () - start) / (ROUNDS * file_cnt));
+    }
+  return 0;
+}
@@ -0,0 +1,111 @@
+/* lookbench.c
+
+   Measures directory lookups under contention.  Creates a
+   directory's worth of files, then starts several child
+   processes at once that each open and close those files over
+   and over, and reports the average cost of one lookup.  The
+   lookups take the directory's inode lock only for reading, so
+   the children should not serialize behind one another.
+
+   Run with no arguments. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Number of files in the directory. */
+#define FILE_CNT 16
+
+/* Number of children looking files up at once. */
+#define CHILD_CNT 8
+
+/* Number of lookups by each child. */
+#define ITERATIONS 1000
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Puts the name of file I into NAME. */
+static void
+file_name (char name[16], int i)
+{
+  snprintf (name, 16, "lookbench%d", i);
+}
+
+/* Opens and closes the files, round robin, ITERATIONS times. */
+static int
+look_up (void)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      char name[16];
+      int fd;
+
+      file_name (name, i % FILE_CNT);
+      fd = open (name);
+      if (fd < 0)
+        return EXIT_FAILURE;
+      close (fd);
+    }
+  return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t children[CHILD_CNT];
+  uint64_t start, cycles;
+  int status = EXIT_SUCCESS;
+  int i;
+
+  /* Started by exec() below. */
+  if (argc > 1 && !strcmp (argv[1], "child"))
+    return look_up ();
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+
+      file_name (name, i);
+      if (!create (name, 0))
+        {
+          printf ("lookbench: create %s failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < CHILD_CNT; i++)
+    children[i] = exec ("lookbench child");
+  for (i = 0; i < CHILD_CNT; i++)
+    if (children[i] == PID_ERROR || wait (children[i]) != EXIT_SUCCESS)
+      status = EXIT_FAILURE;
+  cycles = rdtsc () - start;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+
+      file_name (name, i);
+      remove (name);
+    }
+
+  if (status != EXIT_SUCCESS)
+    {
+      printf ("lookbench: lookups failed\n");
+      return status;
+    }
+  printf ("lookbench: %d processes, %d lookups each, %llu cycles per lookup\n",
+          CHILD_CNT, ITERATIONS,
+          cycles / ((uint64_t) CHILD_CNT * ITERATIONS));
+  return EXIT_SUCCESS;
+}
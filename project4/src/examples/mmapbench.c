@@ -0,0 +1,84 @@
+/* mmapbench.c
+
+   Compares scanning a file through mmap() with reading it into
+   a buffer with read(), by summing every byte of the file named
+   on the command line both ways. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+
+/* Bytes per read() call. */
+#define CHUNK_SIZE 4096
+
+/* Where the file is mapped. */
+#define MAP_ADDR ((const uint8_t *) 0x10000000)
+
+static uint8_t buffer[CHUNK_SIZE];
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Sums the SIZE bytes at P into *SUM. */
+static void
+add_bytes (const uint8_t *p, int size, uint32_t *sum)
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+    *sum += p[i];
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t read_sum = 0, mmap_sum = 0;
+  uint64_t start, read_cycles, mmap_cycles;
+  mapid_t map;
+  int fd, size, n;
+
+  if (argc != 2)
+    {
+      printf ("usage: mmapbench FILE\n");
+      return EXIT_FAILURE;
+    }
+  fd = open (argv[1]);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+  size = filesize (fd);
+
+  start = rdtsc ();
+  while ((n = read (fd, buffer, CHUNK_SIZE)) > 0)
+    add_bytes (buffer, n, &read_sum);
+  read_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  map = mmap (fd, (void *) MAP_ADDR);
+  if (map == MAP_FAILED)
+    {
+      printf ("%s: mmap failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+  add_bytes (MAP_ADDR, size, &mmap_sum);
+  munmap (map);
+  mmap_cycles = rdtsc () - start;
+
+  if (read_sum != mmap_sum)
+    {
+      printf ("mmapbench: checksums differ\n");
+      return EXIT_FAILURE;
+    }
+  printf ("mmapbench: %d bytes, read: %llu cycles, mmap: %llu cycles\n",
+          size, read_cycles, mmap_cycles);
+  close (fd);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+/* nullcall.c
+
+   Measures the round-trip cost of a system call that does no
+   work, entered first with int $0x30 and then with SYSENTER.
+
+   The call used is ioring_enter() in a process that has no ring
+   registered, which returns -1 as soon as it has fetched its
+   arguments. */
+
+#include <ring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall-nr.h>
+#include <sysenter.h>
+
+/* Number of calls timed for each entry path. */
+#define ITERATIONS 10000
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+int
+main (void)
+{
+  uint64_t start, int_cycles, sysenter_cycles;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    ioring_enter (0);
+  int_cycles = (rdtsc () - start) / ITERATIONS;
+  printf ("nullcall: int $0x30: %llu cycles\n", int_cycles);
+
+  if (!sysenter_supported ())
+    {
+      printf ("nullcall: sysenter not supported\n");
+      return 0;
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    sysenter1 (SYS_IORING_ENTER, 0);
+  sysenter_cycles = (rdtsc () - start) / ITERATIONS;
+  printf ("nullcall: sysenter:   %llu cycles\n", sysenter_cycles);
+  return 0;
+}
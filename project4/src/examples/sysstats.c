@@ -0,0 +1,26 @@
+/* sysstats.c
+
+   Prints the number of calls to each system call since boot and
+   the average time spent handling each one. */
+
+#include <stdio.h>
+#include <syscall-nr.h>
+#include <syscall-stats.h>
+
+int
+main (void)
+{
+  int number;
+
+  for (number = 0; number < SYS_CNT; number++)
+    {
+      struct syscall_stat stat;
+
+      if (syscall_stats (number, &stat) < 0)
+        return 1;
+      if (stat.count > 0)
+        printf ("sysstats: call %2d: %8llu calls, %8llu cycles each\n",
+                number, stat.count, stat.cycles / stat.count);
+    }
+  return 0;
+}
@@ -1,14 +1,29 @@
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 
+/* Cache of buffer cache entries. */
+static struct kmem_cache *entry_cache;
+
+/* Periodic write-back, run by a worker every WRITE_BACK_INTERVAL
+   ticks.  Read-ahead is queued on filesys_read_ahead_wq. */
+static struct workqueue write_back_wq;
+static struct delayed_work write_back_work;
+
+static void write_back (void *aux);
+
 void filesys_cache_init (void)
 {
+  entry_cache = kmem_cache_create("cache_entry", sizeof(struct cache_entry),
+				  NULL);
   list_init(&filesys_cache);
   lock_init(&filesys_cache_lock);
   filesys_cache_size = 0;
-  thread_create("filesys_cache_writeback", 0, thread_func_write_back, NULL);
+  workqueue_init(&write_back_wq, "cache write-back", PRI_MIN);
+  workqueue_init(&filesys_read_ahead_wq, "cache read-ahead", PRI_DEFAULT);
+  delayed_work_init(&write_back_work, write_back, NULL);
+  queue_delayed_work(&write_back_wq, &write_back_work, WRITE_BACK_INTERVAL);
 }
 
 struct cache_entry* block_in_cache (block_sector_t sector)
@@ -56,12 +71,13 @@ struct cache_entry* filesys_cache_block_evict (block_sector_t sector,
   if (filesys_cache_size < MAX_FILESYS_CACHE_SIZE)
     {
       filesys_cache_size++;
-      c = malloc(sizeof(struct cache_entry));
+      c = kmem_cache_alloc(entry_cache);
       if (!c)
 	{
 	  return NULL;
 	}
       c->open_cnt = 0;
+      rwlock_init(&c->lock);
       list_push_back(&filesys_cache, &c->elem);
     }
   else
@@ -112,48 +128,44 @@ void filesys_cache_write_to_disk (bool halt)
       struct cache_entry *c = list_entry(e, struct cache_entry, elem);
       if (c->dirty)
 	{
+	  rwlock_acquire_read(&c->lock);
 	  block_write (fs_device, c->sector, &c->block);
 	  c->dirty = false;
+	  rwlock_release_read(&c->lock);
 	}
       if (halt)
 	{
 	  list_remove(&c->elem);
-	  free(c);
+	  kmem_cache_free(entry_cache, c);
 	}
       e = next;
     }
-  lock_release(&filesys_cache_lock);
-}
-
-void thread_func_write_back (void *aux UNUSED)
-{
-  while (true)
+  if (halt)
     {
-      timer_sleep(WRITE_BACK_INTERVAL);
-      filesys_cache_write_to_disk(false);
+      filesys_cache_size = 0;
     }
+  lock_release(&filesys_cache_lock);
 }
 
-void spawn_thread_read_ahead (block_sector_t sector)
+static void write_back (void *aux UNUSED)
 {
-  block_sector_t *arg = malloc(sizeof(block_sector_t));
-  if (arg)
-    {
-      *arg = sector + 1;
-      thread_create("filesys_cache_readahead", 0, thread_func_read_ahead,
-      		    arg);
-    }
+  filesys_cache_write_to_disk(false);
+  queue_delayed_work(&write_back_wq, &write_back_work, WRITE_BACK_INTERVAL);
 }
 
-void thread_func_read_ahead (void *aux)
+/* Brings SECTOR into the cache, if it is not there already,
+   without keeping it pinned.  Meant to run on a worker. */
+void filesys_cache_read_ahead (block_sector_t sector)
 {
-  block_sector_t sector = * (block_sector_t *) aux;
   lock_acquire(&filesys_cache_lock);
   struct cache_entry *c = block_in_cache(sector);
   if (!c)
     {
-      filesys_cache_block_evict(sector, false);
+      c = filesys_cache_block_evict(sector, false);
+      if (c)
+	{
+	  c->open_cnt--;
+	}
     }
   lock_release(&filesys_cache_lock);
-  free(aux);
 }
@@ -4,6 +4,7 @@
 #include "devices/block.h"
 #include "devices/timer.h"
 #include "threads/synch.h"
+#include "threads/workqueue.h"
 #include <list.h>
 
 #define WRITE_BACK_INTERVAL 5*TIMER_FREQ
@@ -12,6 +13,7 @@
 struct list filesys_cache;
 uint32_t filesys_cache_size;
 struct lock filesys_cache_lock;
+struct workqueue filesys_read_ahead_wq;
 
 struct cache_entry {
   uint8_t block[BLOCK_SECTOR_SIZE];
@@ -19,6 +21,7 @@ struct cache_entry {
   bool dirty;
   bool accessed;
   int open_cnt;
+  struct rwlock lock;		/* Guards BLOCK while pinned. */
   struct list_elem elem;
 };
 
@@ -29,8 +32,6 @@ struct cache_entry* filesys_cache_block_get (block_sector_t sector,
 struct cache_entry* filesys_cache_block_evict (block_sector_t sector,
 					       bool dirty);
 void filesys_cache_write_to_disk (bool halt);
-void thread_func_write_back (void *aux);
-void thread_func_read_ahead (void *aux);
-void spawn_thread_read_ahead (block_sector_t sector);
+void filesys_cache_read_ahead (block_sector_t sector);
 
 #endif /* filesys/cache.h */
@@ -29,6 +29,8 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  file_init ();
+  dir_init ();
   filesys_cache_init();
   free_map_init ();
 
@@ -7,6 +7,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -105,7 +106,7 @@ struct inode
     size_t double_indirect_index;
     bool isdir;
     block_sector_t parent;
-    struct lock lock;
+    struct rwlock lock;                 /* Directory entries, extension. */
     block_sector_t ptr[INODE_BLOCK_PTRS];  /* Pointers to blocks */
   };
 
@@ -156,11 +157,33 @@ byte_to_sector (const struct inode *inode, off_t length, off_t pos)
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Guards open_inodes and the open counts of the inodes on it.
+   Directory lookups only hold their directory's lock for
+   reading, so two processes may open the same inode at once. */
+static struct lock open_inodes_lock;
+
+/* Cache of in-memory inodes. */
+static struct kmem_cache *inode_cache;
+
+/* Request to read ahead the sector that holds byte OFFSET of
+   INODE, which is held open until the request has run. */
+struct read_ahead
+  {
+    struct work work;
+    struct inode *inode;
+    off_t offset;
+  };
+
+static void inode_read_ahead (struct inode *inode, off_t offset);
+static void read_ahead (void *ra_);
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -211,29 +234,35 @@ inode_open (block_sector_t sector)
   struct inode *inode;
 
   /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize.  Nobody else can find INODE until the lock is
+     released, so it is complete by the time they do. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init(&inode->lock);
+  rwlock_init(&inode->lock);
   struct inode_disk data;
   block_read(fs_device, inode->sector, &data);
   inode->length = data.length;
@@ -244,6 +273,7 @@ inode_open (block_sector_t sector)
   inode->isdir = data.isdir;
   inode->parent = data.parent;
   memcpy(&inode->ptr, &data.ptr, INODE_BLOCK_PTRS*sizeof(block_sector_t));
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -252,7 +282,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -273,7 +307,10 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
+  /* Release resources if this was the last opener.  The lock is
+     held until the inode is back on disk, so that a concurrent
+     inode_open() does not read it from there first. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
@@ -300,8 +337,9 @@ inode_close (struct inode *inode)
 		 INODE_BLOCK_PTRS*sizeof(block_sector_t));
 	  block_write(fs_device, inode->sector, &disk_inode);
 	}
-      free (inode); 
+      kmem_cache_free (inode_cache, inode);
     }
+  lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -346,8 +384,10 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
         break;
 
       struct cache_entry *c = filesys_cache_block_get(sector_idx, false);
+      rwlock_acquire_read(&c->lock);
       memcpy (buffer + bytes_read, (uint8_t *) &c->block + sector_ofs,
 	      chunk_size);
+      rwlock_release_read(&c->lock);
       c->accessed = true;
       c->open_cnt--;
 
@@ -357,9 +397,49 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       bytes_read += chunk_size;
     }
 
+  /* A read that stops at the end of a sector is likely to be
+     followed by one of the next sector. */
+  if (bytes_read > 0 && offset % BLOCK_SECTOR_SIZE == 0 && offset < length)
+    {
+      inode_read_ahead (inode, offset);
+    }
+
   return bytes_read;
 }
 
+/* Queues a read of the sector holding byte OFFSET of INODE into
+   the buffer cache.  Finding the sector may itself take disk
+   reads of indirect blocks, so that is left to the worker too. */
+static void
+inode_read_ahead (struct inode *inode, off_t offset)
+{
+  struct read_ahead *ra = malloc (sizeof *ra);
+  if (ra == NULL)
+    {
+      return;
+    }
+  ra->inode = inode_reopen (inode);
+  ra->offset = offset;
+  work_init (&ra->work, read_ahead, ra);
+  queue_work (&filesys_read_ahead_wq, &ra->work);
+}
+
+/* Work function for inode_read_ahead(). */
+static void
+read_ahead (void *ra_)
+{
+  struct read_ahead *ra = ra_;
+  off_t length = ra->inode->read_length;
+
+  if (ra->offset < length)
+    {
+      filesys_cache_read_ahead (byte_to_sector (ra->inode, length,
+						ra->offset));
+    }
+  inode_close (ra->inode);
+  free (ra);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -407,8 +487,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
         break;
 
       struct cache_entry *c = filesys_cache_block_get(sector_idx, true);
+      rwlock_acquire_write(&c->lock);
       memcpy ((uint8_t *) &c->block + sector_ofs, buffer + bytes_written,
 	      chunk_size);
+      rwlock_release_write(&c->lock);
       c->accessed = true;
       c->dirty = true;
       c->open_cnt--;
@@ -687,12 +769,26 @@ bool inode_add_parent (block_sector_t parent_sector,
   return true;
 }
 
+/* Locks INODE for writing: extending it, or changing the entries
+   of a directory. */
 void inode_lock (const struct inode *inode)
 {
-  lock_acquire(&((struct inode *)inode)->lock);
+  rwlock_acquire_write(&((struct inode *)inode)->lock);
 }
 
 void inode_unlock (const struct inode *inode)
 {
-  lock_release(&((struct inode *) inode)->lock);
+  rwlock_release_write(&((struct inode *) inode)->lock);
+}
+
+/* Locks INODE for reading, e.g. to look up a directory entry.
+   Any number of readers may hold it at once. */
+void inode_lock_read (const struct inode *inode)
+{
+  rwlock_acquire_read(&((struct inode *)inode)->lock);
+}
+
+void inode_unlock_read (const struct inode *inode)
+{
+  rwlock_release_read(&((struct inode *) inode)->lock);
 }
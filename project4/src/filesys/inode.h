@@ -26,5 +26,7 @@ bool inode_add_parent (block_sector_t parent_sector,
 		       block_sector_t child_sector);
 void inode_lock (const struct inode *inode);
 void inode_unlock (const struct inode *inode);
+void inode_lock_read (const struct inode *inode);
+void inode_unlock_read (const struct inode *inode);
 
 #endif /* filesys/inode.h */
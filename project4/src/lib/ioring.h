@@ -0,0 +1,62 @@
+#ifndef __LIB_IORING_H
+#define __LIB_IORING_H
+
+#include <stdint.h>
+
+/* Batched asynchronous I/O ring, shared between a user process
+   and the kernel.
+
+   The ring occupies exactly one page of the process's address
+   space.  The process fills submission queue entries (SQEs) and
+   advances SQ_TAIL; a kernel worker thread consumes them,
+   advances SQ_HEAD, and posts one completion queue entry (CQE)
+   per request at CQ_TAIL.  The process reaps completions and
+   advances CQ_HEAD.  Indexes increase without bound and are
+   reduced modulo the queue size when used. */
+
+/* Number of entries in each queue.  Must be powers of 2. */
+#define IORING_SQ_ENTRIES 64
+#define IORING_CQ_ENTRIES 128
+
+/* Request opcodes. */
+enum ioring_op
+  {
+    IORING_OP_NOP,              /* Do nothing; completes with 0. */
+    IORING_OP_OPEN,             /* open (ADDR). */
+    IORING_OP_READ,             /* read (FD, ADDR, LEN). */
+    IORING_OP_WRITE,            /* write (FD, ADDR, LEN). */
+    IORING_OP_CLOSE,            /* close (FD). */
+    IORING_OP_PREAD             /* Read LEN bytes at OFFSET. */
+  };
+
+/* Submission queue entry. */
+struct ioring_sqe
+  {
+    uint32_t opcode;            /* One of IORING_OP_*. */
+    int32_t fd;                 /* File descriptor. */
+    void *addr;                 /* Buffer or file name. */
+    uint32_t len;               /* Buffer length in bytes. */
+    uint32_t offset;            /* File offset for IORING_OP_PREAD. */
+    uint32_t user_data;         /* Copied into the completion. */
+  };
+
+/* Completion queue entry. */
+struct ioring_cqe
+  {
+    uint32_t user_data;         /* From the submission. */
+    int32_t res;                /* Result of the operation, -1 on error. */
+  };
+
+/* The shared ring.  Must be page-aligned. */
+struct ioring
+  {
+    volatile uint32_t sq_head;  /* Next SQE the kernel consumes. */
+    volatile uint32_t sq_tail;  /* Next SQE the process fills. */
+    volatile uint32_t cq_head;  /* Next CQE the process reaps. */
+    volatile uint32_t cq_tail;  /* Next CQE the kernel posts. */
+    struct ioring_sqe sq[IORING_SQ_ENTRIES];
+    struct ioring_cqe cq[IORING_CQ_ENTRIES];
+  }
+__attribute__ ((aligned (4096)));
+
+#endif /* lib/ioring.h */
@@ -28,7 +28,19 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Process duplication. */
+    SYS_FORK,                   /* Copy this process. */
+
+    /* Batched asynchronous I/O. */
+    SYS_IORING_SETUP,           /* Register a submission/completion ring. */
+    SYS_IORING_ENTER,           /* Kick the ring and wait for completions. */
+
+    /* Instrumentation. */
+    SYS_SYSCALL_STATS,          /* Report per-system call statistics. */
+
+    SYS_CNT                     /* Number of system calls. */
   };
 
 #endif /* lib/syscall-nr.h */
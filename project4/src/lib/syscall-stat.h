@@ -0,0 +1,14 @@
+#ifndef __LIB_SYSCALL_STAT_H
+#define __LIB_SYSCALL_STAT_H
+
+#include <stdint.h>
+
+/* Statistics for one system call, as reported by
+   SYS_SYSCALL_STATS.  Counts are system-wide, since boot. */
+struct syscall_stat
+  {
+    uint64_t count;             /* Number of calls. */
+    uint64_t cycles;            /* Time spent handling them, in TSC cycles. */
+  };
+
+#endif /* lib/syscall-stat.h */
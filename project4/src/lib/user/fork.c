@@ -0,0 +1,14 @@
+#include "fork.h"
+#include <syscall-nr.h>
+
+pid_t
+fork (void)
+{
+  pid_t pid;
+
+  asm volatile ("pushl %[number]; int $0x30; addl $4, %%esp"
+                : "=a" (pid)
+                : [number] "i" (SYS_FORK)
+                : "memory");
+  return pid;
+}
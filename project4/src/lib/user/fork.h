@@ -0,0 +1,12 @@
+#ifndef __LIB_USER_FORK_H
+#define __LIB_USER_FORK_H
+
+#include <syscall.h>
+
+/* Creates a copy of the running process.  Returns 0 in the
+   child, the child's process id in the parent, or PID_ERROR if
+   the copy could not be made.  The child is waited for with
+   wait(), just like a child started with exec(). */
+pid_t fork (void);
+
+#endif /* lib/user/fork.h */
@@ -0,0 +1,60 @@
+#include "ring.h"
+#include <syscall-nr.h>
+
+/* Invokes syscall NUMBER, passing argument ARG0, and returns the
+   return value as an `int'. */
+#define syscall1(NUMBER, ARG0)                                           \
+        ({                                                               \
+          int retval;                                                    \
+          asm volatile                                                   \
+            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+               : "=a" (retval)                                           \
+               : [number] "i" (NUMBER),                                  \
+                 [arg0] "g" (ARG0)                                       \
+               : "memory");                                              \
+          retval;                                                        \
+        })
+
+/* Registers RING with the kernel.  Returns 0 if successful, -1
+   on failure. */
+int
+ioring_setup (struct ioring *ring)
+{
+  return syscall1 (SYS_IORING_SETUP, ring);
+}
+
+/* Copies SQE into RING's submission queue.  Returns false if the
+   queue is full.  The request is not seen by the kernel until
+   the next call to ioring_enter(). */
+bool
+ioring_queue (struct ioring *ring, const struct ioring_sqe *sqe)
+{
+  if (ring->sq_tail - ring->sq_head >= IORING_SQ_ENTRIES)
+    return false;
+  ring->sq[ring->sq_tail % IORING_SQ_ENTRIES] = *sqe;
+  asm volatile ("" : : : "memory");
+  ring->sq_tail++;
+  return true;
+}
+
+/* Submits every queued request and waits until at least
+   MIN_COMPLETE completions are ready.  Returns the number of
+   completions ready to reap, or -1 on failure. */
+int
+ioring_enter (unsigned min_complete)
+{
+  return syscall1 (SYS_IORING_ENTER, min_complete);
+}
+
+/* Removes the oldest completion from RING into *CQE.  Returns
+   false if no completion is ready. */
+bool
+ioring_reap (struct ioring *ring, struct ioring_cqe *cqe)
+{
+  if (ring->cq_head == ring->cq_tail)
+    return false;
+  *cqe = ring->cq[ring->cq_head % IORING_CQ_ENTRIES];
+  asm volatile ("" : : : "memory");
+  ring->cq_head++;
+  return true;
+}
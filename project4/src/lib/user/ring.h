@@ -0,0 +1,15 @@
+#ifndef __LIB_USER_RING_H
+#define __LIB_USER_RING_H
+
+#include <ioring.h>
+#include <stdbool.h>
+
+/* User-side interface to the batched asynchronous I/O ring.
+   Declare the ring itself as a static or global object, which
+   gives it the page alignment the kernel requires. */
+int ioring_setup (struct ioring *);
+bool ioring_queue (struct ioring *, const struct ioring_sqe *);
+int ioring_enter (unsigned min_complete);
+bool ioring_reap (struct ioring *, struct ioring_cqe *);
+
+#endif /* lib/user/ring.h */
@@ -0,0 +1,17 @@
+#include "syscall-stats.h"
+#include <syscall-nr.h>
+
+int
+syscall_stats (int number, struct syscall_stat *stat)
+{
+  int retval;
+
+  asm volatile ("pushl %[arg1]; pushl %[arg0]; pushl %[number]; "
+                "int $0x30; addl $12, %%esp"
+                : "=a" (retval)
+                : [number] "i" (SYS_SYSCALL_STATS),
+                  [arg0] "r" (number),
+                  [arg1] "r" (stat)
+                : "memory");
+  return retval;
+}
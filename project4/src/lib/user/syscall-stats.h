@@ -0,0 +1,11 @@
+#ifndef __LIB_USER_SYSCALL_STATS_H
+#define __LIB_USER_SYSCALL_STATS_H
+
+#include <syscall-stat.h>
+
+/* Stores the statistics for system call NUMBER, counted across
+   all processes since boot, into *STAT.  Returns 0 if
+   successful, -1 if NUMBER is not a system call number. */
+int syscall_stats (int number, struct syscall_stat *stat);
+
+#endif /* lib/user/syscall-stats.h */
@@ -0,0 +1,37 @@
+#ifndef __LIB_USER_SYSENTER_H
+#define __LIB_USER_SYSENTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Returns true if the CPU supports the SYSENTER instruction, in
+   which case the kernel accepts system calls made with it. */
+static inline bool
+sysenter_supported (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1), "c" (0));
+  return (edx & (1u << 11)) != 0;
+}
+
+/* Invokes syscall NUMBER through SYSENTER instead of int $0x30,
+   passing argument ARG0, and returns the return value as an
+   `int'.  Arguments are pushed exactly as for int $0x30; the
+   kernel finds them through %ecx and resumes at %edx. */
+#define sysenter1(NUMBER, ARG0)                                          \
+        ({                                                               \
+          int retval;                                                    \
+          asm volatile                                                   \
+            ("pushl %[arg0]; pushl %[number]; "                          \
+             "movl %%esp, %%ecx; movl $1f, %%edx; sysenter; 1: "         \
+             "addl $8, %%esp"                                            \
+               : "=a" (retval)                                           \
+               : [number] "i" (NUMBER),                                  \
+                 [arg0] "g" (ARG0)                                       \
+               : "ecx", "edx", "memory");                                \
+          retval;                                                        \
+        })
+
+#endif /* lib/user/sysenter.h */
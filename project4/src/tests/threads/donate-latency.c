@@ -0,0 +1,96 @@
+/* Measures how long a high-priority thread waits for a lock held
+   by a low-priority thread while medium-priority threads compete
+   for the CPU.  With priority donation the wait is bounded by
+   the length of the low-priority thread's critical section;
+   without it, the medium-priority threads would keep the holder
+   off the CPU for as long as they run.
+
+   This is a benchmark, not a graded test. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Length of the critical section, in timer ticks. */
+#define CRITICAL_TICKS 10
+
+/* How long each medium-priority thread runs, in timer ticks. */
+#define MEDIUM_TICKS 100
+
+/* Number of medium-priority threads. */
+#define MEDIUM_CNT 2
+
+static struct lock lock;
+static struct semaphore done;
+static int64_t wait_ticks;
+
+static thread_func low_thread, medium_thread, high_thread;
+
+/* Spins for TICKS timer ticks. */
+static void
+spin (int64_t ticks)
+{
+  int64_t start = timer_ticks ();
+  while (timer_elapsed (start) < ticks)
+    continue;
+}
+
+void
+test_donate_latency (void)
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+  sema_init (&done, 0);
+  thread_set_priority (PRI_MAX);
+
+  /* Let the low-priority thread take the lock. */
+  thread_create ("low", PRI_DEFAULT - 10, low_thread, NULL);
+  timer_sleep (1);
+
+  for (i = 0; i < MEDIUM_CNT; i++)
+    thread_create ("medium", PRI_DEFAULT, medium_thread, NULL);
+  thread_create ("high", PRI_DEFAULT + 10, high_thread, NULL);
+
+  /* Wait for everyone to finish. */
+  for (i = 0; i < MEDIUM_CNT + 2; i++)
+    sema_down (&done);
+
+  msg ("high-priority thread waited %lld ticks for a %d-tick "
+       "critical section", (long long) wait_ticks, CRITICAL_TICKS);
+  if (wait_ticks > CRITICAL_TICKS + 1)
+    fail ("lock wait was not bounded by the critical section");
+  pass ();
+}
+
+static void
+low_thread (void *aux UNUSED)
+{
+  lock_acquire (&lock);
+  spin (CRITICAL_TICKS);
+  lock_release (&lock);
+  sema_up (&done);
+}
+
+static void
+medium_thread (void *aux UNUSED)
+{
+  spin (MEDIUM_TICKS);
+  sema_up (&done);
+}
+
+static void
+high_thread (void *aux UNUSED)
+{
+  int64_t start = timer_ticks ();
+
+  lock_acquire (&lock);
+  wait_ticks = timer_elapsed (start);
+  lock_release (&lock);
+  sema_up (&done);
+}
@@ -0,0 +1,71 @@
+/* Measures malloc() and free() at several block sizes.  For each
+   size, first allocates and frees a single block over and over,
+   which used to get and free a page every time, then keeps a
+   table of live blocks and repeatedly replaces a random one.
+
+   This is a benchmark, not a graded test: it passes as long as
+   every allocation succeeds. */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/malloc.h"
+
+/* Number of live blocks in the churn phase. */
+#define SLOT_CNT 256
+
+/* Number of operations in each phase. */
+#define ROUNDS 20000
+
+static void *slots[SLOT_CNT];
+
+void
+test_malloc_churn (void)
+{
+  static const size_t sizes[] = {16, 64, 256, 1024};
+  size_t s;
+
+  random_init (0);
+  for (s = 0; s < sizeof sizes / sizeof *sizes; s++)
+    {
+      size_t size = sizes[s];
+      uint64_t start, pair_cycles, churn_cycles;
+      size_t i;
+      int round;
+
+      start = rdtsc ();
+      for (round = 0; round < ROUNDS; round++)
+        {
+          void *p = malloc (size);
+          if (p == NULL)
+            fail ("malloc (%zu) failed", size);
+          free (p);
+        }
+      pair_cycles = rdtsc () - start;
+
+      start = rdtsc ();
+      for (round = 0; round < ROUNDS; round++)
+        {
+          void **slot = &slots[random_ulong () % SLOT_CNT];
+
+          free (*slot);
+          *slot = malloc (size);
+          if (*slot == NULL)
+            fail ("malloc (%zu) failed", size);
+        }
+      churn_cycles = rdtsc () - start;
+
+      for (i = 0; i < SLOT_CNT; i++)
+        {
+          free (slots[i]);
+          slots[i] = NULL;
+        }
+
+      msg ("%4zu bytes: %lld cycles per malloc/free pair, "
+           "%lld under churn", size,
+           (long long) (pair_cycles / ROUNDS),
+           (long long) (churn_cycles / ROUNDS));
+    }
+  pass ();
+}
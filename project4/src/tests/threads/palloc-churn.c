@@ -0,0 +1,99 @@
+/* Measures the page allocator under churn.  Keeps a table of
+   live allocations of 1 to 8 pages and repeatedly replaces a
+   random entry, then reports the average cost of an allocation
+   and a free and how fragmented the kernel pool has become.
+
+   This is a benchmark, not a graded test: it passes as long as
+   the allocator hands out sane blocks and takes them back. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Number of live allocations. */
+#define SLOT_CNT 64
+
+/* Number of replacements. */
+#define ROUNDS 20000
+
+/* Largest allocation, in pages. */
+#define MAX_PAGES 8
+
+struct slot
+  {
+    void *pages;                /* Allocated pages, or null. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct slot slots[SLOT_CNT];
+
+void
+test_palloc_churn (void)
+{
+  uint64_t alloc_cycles = 0, free_cycles = 0;
+  long long alloc_cnt = 0, free_cnt = 0, fail_cnt = 0;
+  size_t free_before, largest_before, free_after, largest_after;
+  size_t i;
+  int round;
+
+  random_init (0);
+  palloc_get_usage (0, &free_before, &largest_before);
+  msg ("before: %zu free pages, largest block %zu pages",
+       free_before, largest_before);
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      struct slot *s = &slots[random_ulong () % SLOT_CNT];
+      uint64_t start;
+
+      if (s->pages != NULL)
+        {
+          start = rdtsc ();
+          palloc_free_multiple (s->pages, s->page_cnt);
+          free_cycles += rdtsc () - start;
+          free_cnt++;
+        }
+
+      s->page_cnt = random_ulong () % MAX_PAGES + 1;
+      start = rdtsc ();
+      s->pages = palloc_get_multiple (0, s->page_cnt);
+      alloc_cycles += rdtsc () - start;
+      alloc_cnt++;
+      if (s->pages == NULL)
+        fail_cnt++;
+      else
+        {
+          /* Stamp the first and last pages so that overlapping
+             blocks would show up when they are freed. */
+          memset (s->pages, round & 0xff, 1);
+          memset ((char *) s->pages + (s->page_cnt * PGSIZE) - 1,
+                  round & 0xff, 1);
+        }
+    }
+
+  palloc_get_usage (0, &free_after, &largest_after);
+  msg ("churn: %lld cycles per allocation, %lld cycles per free",
+       (long long) (alloc_cycles / alloc_cnt),
+       free_cnt > 0 ? (long long) (free_cycles / free_cnt) : 0);
+  msg ("churn: %lld of %lld allocations failed", fail_cnt, alloc_cnt);
+  msg ("during: %zu free pages, largest block %zu pages",
+       free_after, largest_after);
+
+  for (i = 0; i < SLOT_CNT; i++)
+    if (slots[i].pages != NULL)
+      {
+        palloc_free_multiple (slots[i].pages, slots[i].page_cnt);
+        slots[i].pages = NULL;
+      }
+
+  palloc_get_usage (0, &free_after, &largest_after);
+  msg ("after: %zu free pages, largest block %zu pages",
+       free_after, largest_after);
+  if (free_after != free_before)
+    fail ("%zu pages leaked", free_before - free_after);
+  pass ();
+}
@@ -0,0 +1,56 @@
+/* Measures the cost of a context switch between two kernel
+   threads that hand control back and forth with a pair of
+   semaphores.  Each round trip is two thread switches.
+
+   This is a benchmark, not a graded test. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of round trips. */
+#define ROUNDS 10000
+
+static struct semaphore ping, pong;
+static thread_func pong_thread;
+
+void
+test_switch_bench (void)
+{
+  uint64_t start, cycles;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  thread_create ("pong", thread_get_priority (), pong_thread, NULL);
+
+  /* Let the other thread start up before timing. */
+  sema_up (&ping);
+  sema_down (&pong);
+
+  start = rdtsc ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  cycles = rdtsc () - start;
+
+  msg ("%lld cycles per thread switch",
+       (long long) (cycles / (2 * ROUNDS)));
+  pass ();
+}
+
+static void
+pong_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i <= ROUNDS; i++)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+}
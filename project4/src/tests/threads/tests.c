@@ -38,6 +38,11 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"palloc-churn", test_palloc_churn},
+    {"malloc-churn", test_malloc_churn},
+    {"switch-bench", test_switch_bench},
+    {"lock-bench", test_lock_bench},
+    {"donate-latency", test_donate_latency},
   };
 
 static const char *test_name;
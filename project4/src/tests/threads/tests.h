@@ -32,6 +32,11 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_palloc_churn;
+extern test_func test_malloc_churn;
+extern test_func test_switch_bench;
+extern test_func test_lock_bench;
+extern test_func test_donate_latency;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,35 @@
+#ifndef THREADS_ATOMIC_H
+#define THREADS_ATOMIC_H
+
+/* Atomic operations on 32-bit words.  Each is a single locked
+   instruction, so it is atomic with respect to interrupts
+   without turning them off, and also a full memory barrier. */
+
+/* If *P equals OLD, sets it to NEW.  Either way, returns the
+   value *P had before. */
+static inline int
+atomic_cmpxchg (volatile int *p, int old, int new)
+{
+  /* See [IA32-v2a] "CMPXCHG". */
+  int prev;
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev;
+}
+
+/* Sets *P to NEW and returns the value it had before. */
+static inline int
+atomic_xchg (volatile int *p, int new)
+{
+  /* See [IA32-v2b] "XCHG".  XCHG with a memory operand is always
+     locked. */
+  asm volatile ("xchgl %0, %1"
+                : "+r" (new), "+m" (*p)
+                :
+                : "memory");
+  return new;
+}
+
+#endif /* threads/atomic.h */
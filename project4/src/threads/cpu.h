@@ -0,0 +1,88 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* CPUID leaf 1 feature bits in EDX.  See [IA32-v2a] "CPUID". */
+#define CPUID_PSE (1u << 3)     /* 4 MB pages. */
+#define CPUID_TSC (1u << 4)     /* Time-stamp counter. */
+#define CPUID_SEP (1u << 11)    /* SYSENTER and SYSEXIT. */
+#define CPUID_PGE (1u << 13)    /* Global pages. */
+
+/* CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE (1u << 4)       /* Page size extensions. */
+#define CR4_PGE (1u << 7)       /* Page global enable. */
+
+/* Model-specific registers.  See [IA32-v3b] appendix B. */
+#define MSR_SYSENTER_CS  0x174  /* Code selector for SYSENTER. */
+#define MSR_SYSENTER_ESP 0x175  /* Stack pointer for SYSENTER. */
+#define MSR_SYSENTER_EIP 0x176  /* Entry point for SYSENTER. */
+
+/* Executes CPUID for LEAF and stores the results into *EAX,
+   *EBX, *ECX, and *EDX. */
+static inline void
+cpuid (uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx,
+       uint32_t *edx)
+{
+  /* See [IA32-v2a] "CPUID". */
+  asm volatile ("cpuid"
+                : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                : "a" (leaf), "c" (0));
+}
+
+/* Returns true if CPUID leaf 1 reports all of the FEATURES bits
+   in EDX. */
+static inline bool
+cpu_has_features (uint32_t features)
+{
+  uint32_t eax, ebx, ecx, edx;
+  cpuid (1, &eax, &ebx, &ecx, &edx);
+  return (edx & features) == features;
+}
+
+/* Returns the value of control register CR4. */
+static inline uint32_t
+read_cr4 (void)
+{
+  uint32_t cr4;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  return cr4;
+}
+
+/* Sets control register CR4 to CR4. */
+static inline void
+write_cr4 (uint32_t cr4)
+{
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+}
+
+/* Returns the value of model-specific register MSR. */
+static inline uint64_t
+rdmsr (uint32_t msr)
+{
+  /* See [IA32-v2b] "RDMSR". */
+  uint64_t value;
+  asm volatile ("rdmsr" : "=A" (value) : "c" (msr));
+  return value;
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  /* See [IA32-v2b] "WRMSR". */
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
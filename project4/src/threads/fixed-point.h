@@ -0,0 +1,59 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point numbers, for the few places where the
+   kernel needs fractions and cannot use floating point.
+
+   A fixed_point value X represents the real number X / FP_ONE:
+   the low 14 bits are the fraction, the rest a signed integer
+   part, so the range is about -131072 to 131072. */
+typedef int32_t fixed_point;
+
+#define FP_FRAC_BITS 14                 /* Number of fraction bits. */
+#define FP_ONE (1 << FP_FRAC_BITS)      /* Fixed-point 1. */
+
+/* Returns integer N as a fixed-point number. */
+static inline fixed_point
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Returns X truncated toward zero to an integer. */
+static inline int
+fp_to_int (fixed_point x)
+{
+  return x / FP_ONE;
+}
+
+/* Returns X rounded to the nearest integer. */
+static inline int
+fp_round (fixed_point x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_point
+fp_add_int (fixed_point x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_point
+fp_mul (fixed_point x, fixed_point y)
+{
+  return (int64_t) x * y / FP_ONE;
+}
+
+/* Returns X / Y. */
+static inline fixed_point
+fp_div (fixed_point x, fixed_point y)
+{
+  return (int64_t) x * FP_ONE / y;
+}
+
+#endif /* threads/fixed-point.h */
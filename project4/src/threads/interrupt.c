@@ -359,6 +359,9 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = true;
       yield_on_return = false;
+
+      /* Bring the time up to date if the tick was stopped. */
+      timer_resume_tick ();
     }
 
   /* Invoke the interrupt's handler. */
@@ -17,16 +17,22 @@
    the free list is nonempty, one of its blocks is used to
    satisfy the request.
 
-   Otherwise, a new page of memory, called an "arena", is
+   Blocks come from pages of memory called "arenas", obtained
+   from the page allocator.  Each arena keeps its own list of
+   free blocks, and the descriptor keeps a list of the arenas
+   that have any free blocks.  A request takes a block from the
+   first of those arenas.  If there is none, a new arena is
    obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
+   malloc() returns a null pointer).  A new arena's blocks are
+   handed out in order before its free list is consulted, so
+   setting one up takes constant time.
 
-   When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   When we free a block, we add it to its arena's free list.  If
+   the arena now has no in-use blocks, we give it back to the
+   page allocator, unless it is the descriptor's only empty
+   arena: that one is kept, so that a workload that repeatedly
+   allocates and frees a single block does not get and free a
+   page every time.  Either way takes constant time.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
@@ -39,7 +45,8 @@ struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
-    struct list free_list;      /* List of free blocks. */
+    struct list arenas;         /* Arenas with free blocks. */
+    size_t empty_cnt;           /* Number of arenas with no blocks in use. */
     struct lock lock;           /* Lock. */
   };
 
@@ -52,12 +59,15 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    size_t fresh_idx;           /* Index of first never-used block. */
+    struct block *free_list;    /* Free blocks other than fresh ones. */
+    struct list_elem elem;      /* Element in descriptor's `arenas'. */
   };
 
 /* Free block. */
 struct block 
   {
-    struct list_elem free_elem; /* Free list element. */
+    struct block *next;         /* Next free block in arena. */
   };
 
 /* Our set of descriptors. */
@@ -79,7 +89,8 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
+      list_init (&d->arenas);
+      d->empty_cnt = 0;
       lock_init (&d->lock);
     }
 }
@@ -121,11 +132,9 @@ malloc (size_t size)
 
   lock_acquire (&d->lock);
 
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* If no arena has a free block, create a new arena. */
+  if (list_empty (&d->arenas))
     {
-      size_t i;
-
       /* Allocate a page. */
       a = palloc_get_page (0);
       if (a == NULL) 
@@ -134,21 +143,29 @@ malloc (size_t size)
           return NULL; 
         }
 
-      /* Initialize arena and add its blocks to the free list. */
+      /* Initialize arena and add it to the descriptor. */
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      a->fresh_idx = 0;
+      a->free_list = NULL;
+      list_push_front (&d->arenas, &a->elem);
+      d->empty_cnt++;
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  /* Get a block from the first arena with one and return it. */
+  a = list_entry (list_front (&d->arenas), struct arena, elem);
+  if (a->free_cnt == d->blocks_per_arena)
+    d->empty_cnt--;
+  if (a->free_list != NULL)
+    {
+      b = a->free_list;
+      a->free_list = b->next;
+    }
+  else
+    b = arena_to_block (a, a->fresh_idx++);
+  if (--a->free_cnt == 0)
+    list_remove (&a->elem);
   lock_release (&d->lock);
   return b;
 }
@@ -228,28 +245,32 @@ free (void *p)
         {
           /* It's a normal block.  We handle it here. */
 
-#ifndef NDEBUG
+#if !defined NDEBUG && !defined NO_POISON
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
   
           lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
+          /* Add block to its arena's free list, and the arena to
+             the descriptor's list if it was full. */
+          b->next = a->free_list;
+          a->free_list = b;
+          if (a->free_cnt++ == 0)
+            list_push_front (&d->arenas, &a->elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* If the arena is now entirely unused, free it, unless
+             it is the only such arena. */
+          if (a->free_cnt >= d->blocks_per_arena) 
             {
-              size_t i;
-
               ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
+              if (d->empty_cnt > 0)
                 {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
+                  list_remove (&a->elem);
+                  palloc_free_page (a);
                 }
-              palloc_free_page (a);
+              else
+                d->empty_cnt++;
             }
 
           lock_release (&d->lock);
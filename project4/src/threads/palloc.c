@@ -1,7 +1,7 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -9,7 +9,9 @@
 #include <string.h>
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,22 +25,82 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept as blocks of 2**ORDER pages, aligned on their size
+   relative to the pool's base, with one free list per order.  An
+   allocation takes the smallest block big enough, splitting
+   larger blocks as needed, and returns any pages beyond the
+   request to the free lists.  A freed block is merged with its
+   buddy, the other half of the block it was split from, as long
+   as that buddy is free too.  Both take O(log n) time.
+
+   Requests for a single zeroed page are common (every new
+   thread and page directory needs one), so low-priority
+   background work keeps a few pages per pool zeroed in advance.
+   Those pages are allocated from the pool and chained together
+   through their first word, which is cleared again when the page
+   is handed out. */
+
+/* Number of pre-zeroed pages kept in each pool.  More are zeroed
+   when a pool has fewer than half that many. */
+#define ZEROED_TARGET 16
+
+/* A pre-zeroed page, apart from this link. */
+struct zeroed_page
+  {
+    struct zeroed_page *next;           /* Next pre-zeroed page. */
+  };
+
+/* Largest block order.  Pools are much smaller than 2**20
+   pages (4 GB). */
+#define MAX_ORDER 20
+
+/* A pool's page map holds one byte per page.  The first page of
+   a free block has PAGE_FREE set and the block's order in the
+   other bits, every allocated page has PAGE_USED, and every
+   other page has 0. */
+#define PAGE_FREE 0x80
+#define PAGE_USED 0x40
+
+/* A free block, stored in its own first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free list. */
+  };
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *page_map;                  /* One byte per page. */
+    size_t page_cnt;                    /* Number of pages. */
     uint8_t *base;                      /* Base of pool. */
+    struct list free[MAX_ORDER + 1];    /* Free blocks, by order. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct zeroed_page *zeroed;         /* Stack of pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pre-zeroed pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Background zeroing of pages. */
+static struct workqueue zero_wq;
+static struct work zero_work;
+
+/* Statistics. */
+static long long zero_hit_cnt;          /* Zeroed pages taken from a pool. */
+static long long zero_miss_cnt;         /* Zeroed pages cleared on demand. */
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void *take_zeroed (struct pool *);
+static work_func zero_pages;
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -59,6 +121,11 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+
+  /* Zero some pages as soon as the workers start. */
+  workqueue_init (&zero_wq, "zero", PRI_MIN);
+  work_init (&zero_work, zero_pages, NULL);
+  queue_work (&zero_wq, &zero_work);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -77,19 +144,37 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = take_zeroed (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  page_idx = alloc_pages (pool, page_cnt);
   lock_release (&pool->lock);
 
-  if (page_idx != BITMAP_ERROR)
+  if (page_idx != SIZE_MAX)
     pages = pool->base + PGSIZE * page_idx;
+  else if (page_cnt == 1)
+    {
+      /* Out of free pages, so fall back on a pre-zeroed one. */
+      pages = take_zeroed (pool);
+      if (pages != NULL)
+        return pages;
+    }
   else
     pages = NULL;
 
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          memset (pages, 0, PGSIZE * page_cnt);
+          if (page_cnt == 1)
+            zero_miss_cnt++;
+        }
     }
   else 
     {
@@ -119,6 +204,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  size_t i;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -133,12 +219,30 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   page_idx = pg_no (pages) - pg_no (pool->base);
 
-#ifndef NDEBUG
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
+  lock_acquire (&pool->lock);
+
+  /* Check for a double free before poisoning, which would
+     overwrite the free list links in a page that is free. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      ASSERT (pool->page_map[page_idx + i] == PAGE_USED);
+      pool->page_map[page_idx + i] = 0;
+    }
+
+#if !defined NDEBUG && !defined NO_POISON
+  /* Poison without holding the lock.  The pages' map entries
+     are already clear, so no allocation or merge can reach
+     them, and holding the lock across the memset would let a
+     thread switch here free a dying thread's page from
+     thread_schedule_tail() while we still hold it. */
+  lock_release (&pool->lock);
   memset (pages, 0xcc, PGSIZE * page_cnt);
+  lock_acquire (&pool->lock);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_range (pool, page_idx, page_cnt);
+  lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +252,253 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Stores into *FREE_CNT the number of free pages in the pool
+   selected by FLAGS, counting pre-zeroed pages, and into *LARGEST the number of pages in
+   the largest free block, which bounds the largest allocation
+   that can succeed. */
+void
+palloc_get_usage (enum palloc_flags flags, size_t *free_cnt, size_t *largest)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  int order;
+
+  lock_acquire (&pool->lock);
+  *free_cnt = pool->free_cnt + pool->zeroed_cnt;
+  *largest = 0;
+  for (order = MAX_ORDER; order >= 0; order--)
+    if (!list_empty (&pool->free[order]))
+      {
+        *largest = (size_t) 1 << order;
+        break;
+      }
+  lock_release (&pool->lock);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Zeroed pages: %lld taken pre-zeroed, %lld zeroed on demand\n",
+          zero_hit_cnt, zero_miss_cnt);
+}
+
+/* Removes a pre-zeroed page from POOL and returns it, or returns
+   a null pointer if POOL has none.  Queues more zeroing if POOL
+   is running low. */
+static void *
+take_zeroed (struct pool *pool)
+{
+  struct zeroed_page *page;
+
+  bool low;
+
+  lock_acquire (&pool->lock);
+  page = pool->zeroed;
+  if (page != NULL)
+    {
+      pool->zeroed = page->next;
+      pool->zeroed_cnt--;
+      zero_hit_cnt++;
+    }
+  low = pool->zeroed_cnt < ZEROED_TARGET / 2;
+  lock_release (&pool->lock);
+
+  if (low)
+    queue_work (&zero_wq, &zero_work);
+  if (page != NULL)
+    page->next = NULL;
+  return page;
+}
+
+/* Tops up POOL's pre-zeroed pages, as long as it has free
+   pages.  Yields after each page so that it only uses time
+   nobody else wants. */
+static void
+fill_zeroed (struct pool *pool)
+{
+  for (;;)
+    {
+      struct zeroed_page *page;
+      size_t page_idx;
+
+      lock_acquire (&pool->lock);
+      page_idx = SIZE_MAX;
+      if (pool->zeroed_cnt < ZEROED_TARGET)
+        page_idx = alloc_pages (pool, 1);
+      lock_release (&pool->lock);
+      if (page_idx == SIZE_MAX)
+        break;
+
+      page = (struct zeroed_page *) (pool->base + PGSIZE * page_idx);
+      memset (page, 0, PGSIZE);
+
+      lock_acquire (&pool->lock);
+      page->next = pool->zeroed;
+      pool->zeroed = page;
+      pool->zeroed_cnt++;
+      lock_release (&pool->lock);
+
+      thread_yield ();
+    }
+}
+
+/* Work that restocks both pools with pre-zeroed pages. */
+static void
+zero_pages (void *aux UNUSED)
+{
+  fill_zeroed (&kernel_pool);
+  fill_zeroed (&user_pool);
+}
+
+/* Returns the first page of POOL's block at PAGE_IDX as a free
+   block. */
+static struct free_block *
+block_at (struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in POOL of the first page of free block B. */
+static size_t
+block_idx (struct pool *pool, struct free_block *b)
+{
+  return ((uint8_t *) b - pool->base) / PGSIZE;
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to POOL's free
+   lists, without merging it with its buddy. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order)
+{
+  pool->page_map[page_idx] = PAGE_FREE | order;
+  list_push_front (&pool->free[order], &block_at (pool, page_idx)->elem);
+}
+
+/* Removes free block B from POOL's free lists. */
+static void
+remove_block (struct pool *pool, struct free_block *b)
+{
+  pool->page_map[block_idx (pool, b)] = 0;
+  list_remove (&b->elem);
+}
+
+/* Returns the order of the smallest block that holds PAGE_CNT
+   pages. */
+static int
+order_for (size_t page_cnt)
+{
+  int order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy as long as the buddy is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  while (order < MAX_ORDER)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || pool->page_map[buddy] != (PAGE_FREE | order))
+        break;
+      remove_block (pool, block_at (pool, buddy));
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   need not form a single block, by freeing the largest aligned
+   blocks that make up the range. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  pool->free_cnt += page_cnt;
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && (page_idx & (((size_t) 2 << order) - 1)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or SIZE_MAX if no free block is large
+   enough.  The pool's lock must be held. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  int want = order_for (page_cnt);
+  int order;
+  size_t page_idx;
+
+  for (order = want; order <= MAX_ORDER; order++)
+    if (!list_empty (&pool->free[order]))
+      break;
+  if (order > MAX_ORDER)
+    return SIZE_MAX;
+
+  page_idx = block_idx (pool, list_entry (list_front (&pool->free[order]),
+                                          struct free_block, elem));
+  remove_block (pool, block_at (pool, page_idx));
+
+  /* Split off upper halves until the block is the right size. */
+  while (order > want)
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+
+  /* Give back the pages beyond the request. */
+  pool->free_cnt -= (size_t) 1 << order;
+  if (page_cnt < (size_t) 1 << order)
+    free_range (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+  memset (pool->page_map + page_idx, PAGE_USED, page_cnt);
+  return page_idx;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's page map at its base.
+     Calculate the space needed for the map
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t map_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  int order;
+
+  if (map_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page map.", name);
+  page_cnt -= map_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->page_map = base;
+  memset (p->page_map, 0, page_cnt);
+  p->page_cnt = page_cnt;
+  p->base = (uint8_t *) base + map_pages * PGSIZE;
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free[order]);
+  p->free_cnt = 0;
+  free_range (p, 0, page_cnt);
+  p->zeroed = NULL;
+  p->zeroed_cnt = 0;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +508,7 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
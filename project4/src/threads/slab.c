@@ -0,0 +1,342 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds every request up to a power of 2 and serves it
+   from a descriptor shared by all objects of that size class.  A
+   kernel structure that is allocated and freed constantly, such
+   as an inode or an open file, does better with a cache of its
+   own: objects are packed exactly into one-page "slabs", and
+   recently freed objects are reused first, while their memory is
+   still in the CPU cache.
+
+   Each cache has two layers.  The bottom layer is a set of slabs,
+   each a page holding a header followed by as many objects as
+   fit.  Slabs with free objects are kept on a list, protected by
+   the cache's lock.  At most one entirely free slab is kept
+   around; others go back to the page allocator.
+
+   The top layer is a "magazine", a small stack of free objects
+   belonging to the CPU.  Allocation and freeing normally just pop
+   or push the magazine with interrupts briefly disabled, which on
+   our single CPU is all the exclusion it needs, so the cache's
+   lock is only taken when the magazine runs empty or full.  Then
+   half a magazine's worth of objects moves between the layers at
+   once. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Number of objects a magazine holds. */
+#define MAG_SIZE 16
+
+/* Slab, at the beginning of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's `partial' list. */
+    void *free;                 /* First free object. */
+    size_t free_cnt;            /* Number of free objects. */
+  };
+
+/* Object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor *ctor;            /* Constructor, or null. */
+
+    struct lock lock;           /* Protects slabs and counters below. */
+    struct list partial;        /* Slabs with free objects. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t empty_cnt;           /* Number of entirely free slabs. */
+
+    void *mag[MAG_SIZE];        /* Magazine of free objects. */
+    size_t mag_cnt;             /* Number of objects in magazine. */
+
+    /* Statistics. */
+    long long alloc_cnt;        /* Objects allocated. */
+    long long mag_hit_cnt;      /* Allocations served by magazine. */
+    size_t in_use;              /* Objects currently allocated. */
+  };
+
+/* All the caches.  Caches are created during startup and never
+   destroyed. */
+static struct kmem_cache caches[16];
+static size_t cache_cnt;
+
+static struct slab *obj_to_slab (void *);
+static void refill_magazine (struct kmem_cache *);
+static void drain_magazine (struct kmem_cache *);
+static void return_objs (struct kmem_cache *, void **objs, size_t cnt);
+
+/* Creates and returns a cache of objects of SIZE bytes named
+   NAME.  If CTOR is nonnull, it is called on each object as it
+   is allocated.  Must be called during startup, before other
+   threads might create caches. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor *ctor)
+{
+  struct kmem_cache *c;
+
+  /* Objects must be able to hold a free-list link and are
+     aligned on a word boundary. */
+  if (size < sizeof (void *))
+    size = sizeof (void *);
+  size = ROUND_UP (size, sizeof (void *));
+  ASSERT (size <= PGSIZE - sizeof (struct slab));
+  ASSERT (cache_cnt < sizeof caches / sizeof *caches);
+
+  c = &caches[cache_cnt++];
+  c->name = name;
+  c->obj_size = size;
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / size;
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  c->slab_cnt = 0;
+  c->empty_cnt = 0;
+  c->mag_cnt = 0;
+  c->alloc_cnt = 0;
+  c->mag_hit_cnt = 0;
+  c->in_use = 0;
+  return c;
+}
+
+/* Obtains and returns a new object from cache C, after running
+   C's constructor on it.  Returns a null pointer if memory is not
+   available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  enum intr_level old_level;
+  void *obj = NULL;
+
+  old_level = intr_disable ();
+  if (c->mag_cnt > 0)
+    {
+      obj = c->mag[--c->mag_cnt];
+      c->mag_hit_cnt++;
+    }
+  intr_set_level (old_level);
+
+  if (obj == NULL)
+    {
+      refill_magazine (c);
+      old_level = intr_disable ();
+      if (c->mag_cnt > 0)
+        obj = c->mag[--c->mag_cnt];
+      intr_set_level (old_level);
+      if (obj == NULL)
+        return NULL;
+    }
+
+  old_level = intr_disable ();
+  c->alloc_cnt++;
+  c->in_use++;
+  intr_set_level (old_level);
+
+  if (c->ctor != NULL)
+    c->ctor (obj);
+  return obj;
+}
+
+/* Like kmem_cache_alloc(), but fills the object with zeros
+   instead of running the constructor. */
+void *
+kmem_cache_zalloc (struct kmem_cache *c)
+{
+  void *obj = kmem_cache_alloc (c);
+
+  if (obj != NULL)
+    memset (obj, 0, c->obj_size);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  Does nothing if OBJ is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  enum intr_level old_level;
+
+  if (obj == NULL)
+    return;
+  ASSERT (obj_to_slab (obj)->cache == c);
+
+#if !defined NDEBUG && !defined NO_POISON
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (obj, 0xcc, c->obj_size);
+#endif
+
+  for (;;)
+    {
+      old_level = intr_disable ();
+      if (c->mag_cnt < MAG_SIZE)
+        {
+          c->mag[c->mag_cnt++] = obj;
+          c->in_use--;
+          intr_set_level (old_level);
+          return;
+        }
+      intr_set_level (old_level);
+      drain_magazine (c);
+    }
+}
+
+/* Prints statistics for each cache. */
+void
+kmem_cache_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct kmem_cache *c = &caches[i];
+      printf ("Cache %s: %zu in use, %zu slabs, "
+              "%lld allocated, %lld from magazine\n",
+              c->name, c->in_use, c->slab_cnt, c->alloc_cnt,
+              c->mag_hit_cnt);
+    }
+}
+
+/* Returns the slab that OBJ is inside. */
+static struct slab *
+obj_to_slab (void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT ((pg_ofs (obj) - sizeof *s) % s->cache->obj_size == 0);
+  return s;
+}
+
+/* Allocates a new slab for cache C, adds it to C's partial list,
+   and returns it, or returns a null pointer if no page is
+   available.  C's lock must be held. */
+static struct slab *
+new_slab (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  uint8_t *obj;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free = NULL;
+  s->free_cnt = c->objs_per_slab;
+  obj = (uint8_t *) (s + 1) + c->obj_size * c->objs_per_slab;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      obj -= c->obj_size;
+      *(void **) obj = s->free;
+      s->free = obj;
+    }
+  list_push_front (&c->partial, &s->elem);
+  c->slab_cnt++;
+  c->empty_cnt++;
+  return s;
+}
+
+/* Moves up to half a magazine of objects from C's slabs into its
+   magazine, allocating a slab if necessary. */
+static void
+refill_magazine (struct kmem_cache *c)
+{
+  void *objs[MAG_SIZE / 2];
+  enum intr_level old_level;
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&c->lock);
+  while (cnt < MAG_SIZE / 2)
+    {
+      struct slab *s;
+
+      if (list_empty (&c->partial) && new_slab (c) == NULL)
+        break;
+      s = list_entry (list_front (&c->partial), struct slab, elem);
+      if (s->free_cnt == c->objs_per_slab)
+        c->empty_cnt--;
+      while (cnt < MAG_SIZE / 2 && s->free != NULL)
+        {
+          objs[cnt++] = s->free;
+          s->free = *(void **) s->free;
+          s->free_cnt--;
+        }
+      if (s->free == NULL)
+        list_remove (&s->elem);
+    }
+  lock_release (&c->lock);
+
+  /* Another thread may have filled the magazine meanwhile, so
+     give back whatever does not fit. */
+  old_level = intr_disable ();
+  for (i = 0; i < cnt && c->mag_cnt < MAG_SIZE; i++)
+    c->mag[c->mag_cnt++] = objs[i];
+  intr_set_level (old_level);
+  if (i < cnt)
+    return_objs (c, objs + i, cnt - i);
+}
+
+/* Moves half of C's magazine back into C's slabs. */
+static void
+drain_magazine (struct kmem_cache *c)
+{
+  void *objs[MAG_SIZE / 2];
+  enum intr_level old_level;
+  size_t cnt = 0;
+
+  old_level = intr_disable ();
+  while (cnt < MAG_SIZE / 2 && c->mag_cnt > 0)
+    objs[cnt++] = c->mag[--c->mag_cnt];
+  intr_set_level (old_level);
+
+  return_objs (c, objs, cnt);
+}
+
+/* Returns the CNT objects in OBJS to C's slabs, freeing entirely
+   free slabs beyond the first. */
+static void
+return_objs (struct kmem_cache *c, void **objs, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&c->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct slab *s = obj_to_slab (objs[i]);
+
+      if (s->free == NULL)
+        list_push_front (&c->partial, &s->elem);
+      *(void **) objs[i] = s->free;
+      s->free = objs[i];
+      if (++s->free_cnt == c->objs_per_slab)
+        {
+          if (c->empty_cnt > 0)
+            {
+              list_remove (&s->elem);
+              s->magic = 0;
+              palloc_free_page (s);
+              c->slab_cnt--;
+            }
+          else
+            c->empty_cnt++;
+        }
+    }
+  lock_release (&c->lock);
+}
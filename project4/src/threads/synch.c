@@ -29,9 +29,20 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "threads/atomic.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Lock states. */
+enum
+  {
+    LOCK_FREE,                  /* Not held. */
+    LOCK_HELD,                  /* Held, with no waiters. */
+    LOCK_CONTENDED              /* Held, maybe with waiters. */
+  };
+
+static list_less_func thread_priority_less;
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -102,7 +113,11 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up one thread of those waiting for SEMA, if any: the
+   one of highest priority, or the one that has waited longest
+   among several of the same priority.  Priorities are compared
+   now, rather than when the threads started waiting, because
+   donation can change them in the meantime.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +129,26 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Returns true if thread A_ has lower priority than thread B_. */
+static bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,20 +202,57 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   Most locks are never contended, so a lock is not built on a
+   semaphore.  Instead, its STATE is taken and given back with a
+   single atomic instruction, without disabling interrupts, and
+   only a thread that finds the lock held goes through the slow
+   path of waiting with interrupts off.  A waiter marks the lock
+   contended, which sends its holder's release through the slow
+   path too, to wake it up.  Only contended locks, which are the
+   only ones that can carry donated priority, are put on their
+   holder's `lock_list'. */
 void
 lock_init (struct lock *lock)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  sema_init (&lock->semaphore, 1);
+  lock->state = LOCK_FREE;
+  list_init (&lock->waiters);
+  lock->listed = false;
+}
+
+/* Puts LOCK, which the current thread has just acquired, on the
+   thread's `lock_list' if other threads are waiting for it, so
+   that they donate their priority to it. */
+static void
+lock_track (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (lock->state == LOCK_CONTENDED && !lock->listed)
+    {
+      list_push_back (&cur->lock_list, &lock->elem);
+      lock->listed = true;
+      if (!thread_mlfqs)
+        thread_update_priority (cur);
+    }
+  intr_set_level (old_level);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While we wait, the lock's holder runs at no lower a priority
+   than ours, and so does any thread that it is waiting for in
+   turn.  Otherwise, threads of middling priority could keep the
+   holder, and so us, from running indefinitely.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,13 +260,48 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
-  list_push_back(&thread_current()->lock_list, &lock->elem);
+  /* Fast path: the lock is free. */
+  if (atomic_cmpxchg (&lock->state, LOCK_FREE, LOCK_HELD) == LOCK_FREE)
+    {
+      lock->holder = cur;
+      if (lock->state == LOCK_CONTENDED)
+        lock_track (lock);
+      return;
+    }
+
+  /* Slow path.  Once we mark the lock contended, its holder must
+     wake us when it releases it.  The holder may not have
+     recorded itself in HOLDER yet, in which case it will put the
+     lock on its `lock_list' when it does. */
+  old_level = intr_disable ();
+  while (atomic_xchg (&lock->state, LOCK_CONTENDED) != LOCK_FREE)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder != NULL && !lock->listed)
+        {
+          list_push_back (&holder->lock_list, &lock->elem);
+          lock->listed = true;
+        }
+      if (!thread_mlfqs)
+        {
+          cur->wait_lock = lock;
+          thread_donate_priority (holder, cur->priority);
+        }
+      list_push_back (&lock->waiters, &cur->elem);
+      thread_block ();
+    }
+  cur->wait_lock = NULL;
+  lock->holder = cur;
+  lock_track (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -210,21 +313,20 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
-  bool success;
-
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
-  if (success)
-    {
-      lock->holder = thread_current ();
-      list_push_back(&thread_current()->lock_list, &lock->elem);
-    }
-  return success;
+  if (atomic_cmpxchg (&lock->state, LOCK_FREE, LOCK_HELD) != LOCK_FREE)
+    return false;
+  lock->holder = thread_current ();
+  if (lock->state == LOCK_CONTENDED)
+    lock_track (lock);
+  return true;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Gives up any priority donated through LOCK, which may cause
+   the thread woken up to run at once.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -232,12 +334,41 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  /* Fast path: nobody is waiting. */
+  if (!lock->listed)
+    {
+      lock->holder = NULL;
+      if (atomic_cmpxchg (&lock->state, LOCK_HELD, LOCK_FREE) == LOCK_HELD)
+        return;
+    }
+
+  /* Slow path.  Free the lock and wake the waiter of highest
+     priority, which marks it contended again when it takes it,
+     in case there are more waiters behind it. */
+  old_level = intr_disable ();
   lock->holder = NULL;
-  list_remove(&lock->elem);
-  sema_up (&lock->semaphore);
+  if (lock->listed)
+    {
+      list_remove (&lock->elem);
+      lock->listed = false;
+      if (!thread_mlfqs)
+        thread_update_priority (thread_current ());
+    }
+  lock->state = LOCK_FREE;
+  if (!list_empty (&lock->waiters))
+    {
+      struct list_elem *e = list_max (&lock->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -250,14 +381,29 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
-
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A_ has
+   lower priority than the one waiting on B_. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -300,6 +446,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -307,8 +454,9 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the one of highest priority to wake up
+   from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -322,8 +470,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -341,3 +493,133 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW as a reader-writer lock, which any number of
+   readers may hold at once, or a single writer.  Readers may
+   sleep while holding it.
+
+   Writers are preferred: once a writer is waiting, new readers
+   wait behind it, so that a steady stream of readers cannot
+   starve writers.  The writer side is an ordinary lock, which a
+   writer takes as soon as it starts to wait for readers to
+   leave.  Waiting readers wait for that lock too, so threads
+   waiting behind a writer are woken in order of priority, and
+   lend the writer their priority.  Readers are not lent
+   priority.
+
+   A thread must not acquire a reader-writer lock that it
+   already holds, in either mode. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->writer);
+  rw->reader_cnt = 0;
+  rw->writer_waiting = false;
+  sema_init (&rw->drained, 0);
+}
+
+/* Acquires RW for reading, first sleeping until no writer holds
+   or is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+  while (rw->writer.state != LOCK_FREE)
+    {
+      lock_acquire (&rw->writer);
+      lock_release (&rw->writer);
+    }
+  rw->reader_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for reading.
+   If this was the last reader and a writer is waiting, lets the
+   writer in. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0 && rw->writer_waiting)
+    {
+      rw->writer_waiting = false;
+      sema_up (&rw->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other writer holds
+   it and the readers that hold it have left.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->writer);
+
+  /* No new readers can get in now, so wait for the last of the
+     current ones to leave. */
+  old_level = intr_disable ();
+  if (rw->reader_cnt > 0)
+    {
+      rw->writer_waiting = true;
+      sema_down (&rw->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for writing and returns true if successful
+   or false on failure.  Never sleeps. */
+bool
+rwlock_try_acquire_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  success = rw->reader_cnt == 0 && lock_try_acquire (&rw->writer);
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_release (&rw->writer);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise.  Whether it holds RW for reading is not tracked. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->writer);
+}
@@ -20,9 +20,11 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
-    struct semaphore semaphore; /* Binary semaphore controlling access. */
-    struct list_elem elem;
+    struct thread *holder;      /* Thread holding lock. */
+    volatile int state;         /* Free, held, or contended. */
+    struct list waiters;        /* Threads waiting for the lock. */
+    struct list_elem elem;      /* Element in holder's `lock_list'. */
+    bool listed;                /* On holder's `lock_list'? */
   };
 
 void lock_init (struct lock *);
@@ -42,6 +44,23 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock writer;         /* Held by the writer, if any. */
+    unsigned reader_cnt;        /* Number of readers holding it. */
+    bool writer_waiting;        /* Writer waiting for readers to leave? */
+    struct semaphore drained;   /* Upped when the last reader leaves. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
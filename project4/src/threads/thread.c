@@ -4,7 +4,9 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "filesys/directory.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -26,9 +28,14 @@
 #define MIN_FD 2
 #define NO_PARENT -1
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO
+   queue per priority, and bit P of ready_mask is set if and only
+   if the queue for priority P is nonempty, so that finding the
+   highest-priority ready thread takes a single bit scan. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           /* Number of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -58,6 +65,7 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+#define DONATION_DEPTH 8        /* Max length of a priority donation chain. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
@@ -65,11 +73,47 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler.
+
+   Each thread's priority is derived from its niceness and from
+   recent_cpu, a decaying average of the CPU time it has used, so
+   that threads that have not run lately are favored.  recent_cpu
+   decays once a second at a rate that depends on load_avg, a
+   decaying average of the number of threads ready to run.
+
+   Between those once-a-second updates, only the running thread's
+   recent_cpu changes, so every fourth tick only its priority is
+   recomputed.  Once a second, the timer interrupt updates only
+   load_avg and the decay factor derived from it, then wakes the
+   "mlfqs" thread to decay every thread's recent_cpu.  That
+   thread runs at PRI_MAX, so the decay still happens before any
+   other thread runs, but it walks all_list in batches of
+   MLFQS_BATCH threads with interrupts enabled in between.
+   mlfqs_next is where the walk resumes; thread_exit() moves it
+   past a thread that leaves all_list. */
+#define MLFQS_PRI_TICKS 4       /* Ticks between priority updates. */
+#define MLFQS_BATCH 16          /* Threads decayed per interrupts-off run. */
+static fixed_point load_avg;    /* System load average. */
+static fixed_point mlfqs_decay; /* recent_cpu decay factor. */
+static struct semaphore mlfqs_sema;     /* Upped once a second. */
+static struct thread *mlfqs_thread;     /* Decays recent_cpu. */
+static struct list_elem *mlfqs_next;    /* Next thread to decay. */
+static long long mlfqs_update_cnt;      /* # of once-a-second updates. */
+static long long mlfqs_update_cycles;   /* Total CPU cycles they took. */
+
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_update_load (void);
+static thread_func mlfqs_decay_thread NO_RETURN;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static void set_priority (struct thread *, int priority);
+static int ready_max_priority (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -82,7 +126,7 @@ static tid_t allocate_tid (void);
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -93,12 +137,15 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
+  ready_mask = 0;
   list_init (&all_list);
-  list_init (&sleep_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -123,6 +170,12 @@ thread_start (void)
 
   /* Wait for the idle thread to initialize idle_thread. */
   sema_down (&idle_started);
+
+  if (thread_mlfqs)
+    {
+      sema_init (&mlfqs_sema, 0);
+      thread_create ("mlfqs", PRI_MAX, mlfqs_decay_thread, NULL);
+    }
 }
 
 /* Called by the timer interrupt handler at each timer tick.
@@ -142,6 +195,19 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    {
+      int64_t now = timer_ticks ();
+      bool charge = t != idle_thread && t != mlfqs_thread;
+
+      if (charge)
+        t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (now % TIMER_FREQ == 0)
+        mlfqs_update_load ();
+      else if (now % MLFQS_PRI_TICKS == 0 && charge)
+        mlfqs_update_priority (t);
+    }
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -153,6 +219,9 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (mlfqs_update_cnt > 0)
+    printf ("MLFQS: %lld recent_cpu decays, %lld cycles each\n",
+            mlfqs_update_cnt, mlfqs_update_cycles / mlfqs_update_cnt);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -165,11 +234,9 @@ thread_print_stats (void)
    before thread_create() returns.  Contrariwise, the original
    thread may run for any amount of time before the new thread is
    scheduled.  Use a semaphore or some other form of
-   synchronization if you need to ensure ordering.
-
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   synchronization if you need to ensure ordering.  In
+   particular, if PRIORITY is higher than the running thread's,
+   the new thread runs immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -214,6 +281,7 @@ thread_create (const char *name, int priority,
 
   intr_set_level (old_level);
 
+#ifdef USERPROG
   // Add child process to child list
   t->parent = thread_tid();
   struct child_process *cp = add_child_process(t->tid);
@@ -226,9 +294,11 @@ thread_create (const char *name, int priority,
     {
       t->cwd = NULL;
     }
+#endif
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
 }
@@ -256,7 +326,8 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Call thread_preempt() afterward to let T
+   run at once if it has a higher priority. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -266,7 +337,7 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -320,6 +391,8 @@ thread_exit (void)
      when it calls thread_schedule_tail(). */
   intr_disable ();
   release_locks();
+  if (mlfqs_next == &thread_current ()->allelem)
+    mlfqs_next = list_next (mlfqs_next);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -338,12 +411,30 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a thread of higher priority than the
+   running thread is ready to run.  In an interrupt handler, the
+   yield happens just before the handler returns. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (ready_max_priority () > running_thread ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+  intr_set_level (old_level);
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -361,11 +452,91 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY, and
+   yields if it is no longer the highest.  Priority donated to
+   the thread remains in effect until it releases the locks
+   through which it was donated. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS sets priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Raises T's priority to at least PRIORITY, along with that of
+   the holder of the lock T is waiting for, if any, and so on
+   down the chain, so that a thread waiting for a lock never
+   waits behind threads of lower priority than its own.
+   Interrupts must be off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATION_DEPTH && t != NULL; depth++)
+    {
+      if (t->priority >= priority)
+        break;
+      set_priority (t, priority);
+      t = t->wait_lock != NULL ? t->wait_lock->holder : NULL;
+    }
+}
+
+/* Recomputes T's priority as the higher of its base priority and
+   the priorities of the threads waiting for locks that T holds.
+   Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e, *f;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->lock_list); e != list_end (&t->lock_list);
+       e = list_next (e))
+    {
+      struct list *waiters = &list_entry (e, struct lock, elem)->waiters;
+      for (f = list_begin (waiters); f != list_end (waiters);
+           f = list_next (f))
+        {
+          struct thread *w = list_entry (f, struct thread, elem);
+          if (w->priority > priority)
+            priority = w->priority;
+        }
+    }
+  set_priority (t, priority);
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready.  Interrupts must be off. */
+static void
+set_priority (struct thread *t, int priority)
+{
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -375,37 +546,139 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, and yields if
+   the resulting priority is no longer the highest. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  thread_current ()->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (thread_current ());
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent;
 }
-
+
+/* Recomputes T's priority from its niceness and recent_cpu. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = fp_to_int (fp_from_int (PRI_MAX) - t->recent_cpu / 4)
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  set_priority (t, priority);
+}
+
+/* Updates load_avg and the decay factor for recent_cpu, and
+   wakes the thread that applies it.  Called once a second from
+   the timer interrupt. */
+static void
+mlfqs_update_load (void)
+{
+  struct thread *cur = running_thread ();
+  int ready = ready_cnt + (cur != idle_thread && cur != mlfqs_thread);
+  fixed_point twice_load;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  load_avg = (59 * load_avg + fp_from_int (ready)) / 60;
+  twice_load = 2 * load_avg;
+  mlfqs_decay = fp_div (twice_load, twice_load + FP_ONE);
+  sema_up (&mlfqs_sema);
+}
+
+/* Thread that decays every thread's recent_cpu and recomputes
+   its priority once a second, MLFQS_BATCH threads at a time.
+   The decay factor is computed once, leaving one multiplication
+   and no divisions per thread, and threads with nothing to
+   decay are skipped. */
+static void
+mlfqs_decay_thread (void *aux UNUSED)
+{
+  enum intr_level old_level;
+
+  /* Stay at PRI_MAX, outside the scheduler's own accounting. */
+  old_level = intr_disable ();
+  mlfqs_thread = thread_current ();
+  set_priority (mlfqs_thread, PRI_MAX);
+  intr_set_level (old_level);
+
+  for (;;)
+    {
+      uint64_t start;
+
+      sema_down (&mlfqs_sema);
+      start = rdtsc ();
+
+      old_level = intr_disable ();
+      mlfqs_next = list_begin (&all_list);
+      while (mlfqs_next != list_end (&all_list))
+        {
+          int n;
+
+          for (n = 0; n < MLFQS_BATCH && mlfqs_next != list_end (&all_list);
+               n++)
+            {
+              struct thread *t = list_entry (mlfqs_next, struct thread,
+                                             allelem);
+
+              mlfqs_next = list_next (mlfqs_next);
+              if (t == idle_thread || t == mlfqs_thread
+                  || (t->recent_cpu == 0 && t->nice == 0))
+                continue;
+              t->recent_cpu = fp_add_int (fp_mul (mlfqs_decay,
+                                                  t->recent_cpu),
+                                          t->nice);
+              mlfqs_update_priority (t);
+            }
+
+          /* Let interrupts in between batches. */
+          intr_set_level (old_level);
+          old_level = intr_disable ();
+        }
+      mlfqs_next = NULL;
+      intr_set_level (old_level);
+
+      mlfqs_update_cnt++;
+      mlfqs_update_cycles += rdtsc () - start;
+    }
+}
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -428,6 +701,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing is ready to run, so skip timer ticks until a
+         timer is due. */
+      timer_stop_tick ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -489,7 +766,18 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  if (thread_mlfqs)
+    {
+      /* Inherit niceness and recent_cpu from the creating thread.
+         The initial thread starts out at 0 for both. */
+      if (t != running_thread ())
+        {
+          t->nice = running_thread ()->nice;
+          t->recent_cpu = running_thread ()->recent_cpu;
+        }
+      mlfqs_update_priority (t);
+    }
   t->magic = THREAD_MAGIC;
   list_push_back (&all_list, &t->allelem);
 
@@ -499,10 +787,18 @@ init_thread (struct thread *t, const char *name, int priority)
 
   list_init(&t->file_list);
   t->fd = MIN_FD;
+  lock_init(&t->file_lock);
 
   list_init(&t->child_list);
   t->cp = NULL;
   t->parent = NO_PARENT;
+
+  t->ioring = NULL;
+
+#ifdef VM
+  list_init(&t->mappings);
+  t->next_mapid = 0;
+#endif
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -518,18 +814,78 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns the index of the most significant set bit in X, which
+   must be nonzero. */
+static inline int
+highest_bit (uint32_t x)
+{
+  int bit;
+
+  /* See [IA32-v2a] "BSR". */
+  asm ("bsrl %1, %0" : "=r" (bit) : "rm" (x));
+  return bit;
+}
+
+/* Adds T to the back of the run queue for its priority. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from its run queue. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  ready_cnt--;
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_max_priority (void)
+{
+  uint32_t high = ready_mask >> 32;
+  uint32_t low = ready_mask;
+
+  if (high != 0)
+    return highest_bit (high) + 32;
+  else if (low != 0)
+    return highest_bit (low);
+  else
+    return PRI_MIN - 1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.  The thread chosen is the one that has waited
+   longest among those of the highest priority. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int pri = ready_max_priority ();
+  struct list *queue;
+  struct thread *t;
+
+  if (pri < PRI_MIN)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  queue = &ready_queues[pri];
+  t = list_entry (list_front (queue), struct thread, elem);
+  ready_remove (t);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -635,30 +991,17 @@ bool thread_alive (int pid)
   return false;
 }
 
+/* Releases the contended locks the current thread still holds,
+   so that their waiters are not stuck forever.  lock_release
+   takes each one off lock_list.  Uncontended locks are not
+   tracked; a thread must not exit holding one. */
 void release_locks (void)
 {
   struct thread *t = thread_current();
-  struct list_elem *next, *e = list_begin(&t->lock_list);
 
-  while (e != list_end (&t->lock_list))
+  while (!list_empty (&t->lock_list))
     {
-      next = list_next(e);
-      struct lock *l = list_entry (e, struct lock, elem);
-      lock_release(l);
-      list_remove(&l->elem);
-      e = next;
+      lock_release(list_entry (list_front (&t->lock_list), struct lock,
+			       elem));
     }
 }
-
-bool cmp_ticks (const struct list_elem *a,
-		const struct list_elem *b,
-		void *aux UNUSED)
-{
-  struct thread *ta = list_entry(a, struct thread, elem);
-  struct thread *tb = list_entry(b, struct thread, elem);
-  if (ta->ticks < tb->ticks)
-    {
-      return true;
-    }
-  return false;
-}
@@ -2,11 +2,11 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
-
-// Needed for timer_sleep()
-struct list sleep_list;
+#include "threads/fixed-point.h"
+#include "threads/synch.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -27,6 +27,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -78,10 +83,10 @@ typedef int tid_t;
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
+   a run queue (thread.c), or it can be an element in a
    semaphore wait list (synch.c).  It can be used these two ways
    only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
+   ready state is on a run queue, whereas only a thread in the
    blocked state is on a semaphore wait list. */
 struct thread
   {
@@ -90,7 +95,7 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
     struct list_elem allelem;           /* List element for all threads list. */
 
     /* Shared between thread.c and synch.c. */
@@ -104,12 +109,22 @@ struct thread
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
 
-    // Needed to keep track of locks thread holds
+    // Needed to keep track of contended locks thread holds
     struct list lock_list;
 
+    // Needed for priority donation
+    int base_priority;
+    struct lock *wait_lock;
+
+    // Needed for the MLFQS
+    int nice;
+    fixed_point recent_cpu;
+
     // Needed for file system sys calls
     struct list file_list;
     int fd;
+    // Serializes file_list against the I/O ring worker
+    struct lock file_lock;
 
     // Needed for wait / exec sys calls
     struct list child_list;
@@ -120,10 +135,23 @@ struct thread
     // Needed for denying writes to executables
     struct file* executable;
 
-    // Needed for timer_sleep()
-    int64_t ticks;
-    
     struct dir *cwd;
+
+    // Needed for the batched I/O ring
+    struct ioring_ctx *ioring;
+
+    // Needed for fork and for faults inside system calls
+    struct intr_frame *syscall_frame;
+
+#ifdef VM
+    // Needed for the supplemental page table, owned by vm/page.c
+    struct hash pages;
+    struct lock pages_lock;
+
+    // Needed for memory-mapped files, owned by vm/mmap.c
+    struct list mappings;
+    int next_mapid;
+#endif
   };
 
 /* If false (default), use round-robin scheduler.
@@ -149,6 +177,7 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -156,6 +185,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -165,8 +196,4 @@ int thread_get_load_avg (void);
 bool thread_alive (int pid);
 void release_locks (void);
 
-bool cmp_ticks (const struct list_elem *a,
-		const struct list_elem *b,
-		void *aux UNUSED);
-
 #endif /* threads/thread.h */
@@ -0,0 +1,316 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Workqueues.
+
+   Rather than creating a thread of its own for background work,
+   which costs a page and a TID for a thread that mostly sleeps,
+   a subsystem puts its work on a workqueue, and one of a fixed
+   set of worker threads does it.  A worker always takes the
+   oldest work from the highest-priority queue that has any.
+
+   Work may be queued from interrupt handlers, so the queues are
+   protected by disabling interrupts.  A work is never run by two
+   workers at once: if it is queued again while running, the
+   worker running it puts it back on its queue when it finishes.
+   Until then, the work must stay in memory; once it has started
+   and was not queued again, its function may free it. */
+
+/* Number of worker threads. */
+#define WORKER_CNT 4
+
+/* A worker thread. */
+struct worker
+  {
+    struct work *current;       /* Work being run, or null. */
+    bool requeue;               /* Was CURRENT queued again? */
+  };
+
+static struct worker workers[WORKER_CNT];
+
+/* All workqueues, highest priority first. */
+static struct list queues = LIST_INITIALIZER (queues);
+
+/* Number of works on the queues.  Before the workers start,
+   counted in early_cnt instead. */
+static struct semaphore work_cnt;
+static unsigned early_cnt;
+static bool started;
+
+/* For waiting until a work has been run. */
+static struct lock flush_lock;
+static struct condition work_done;
+
+static thread_func worker_thread NO_RETURN;
+static timer_func delayed_work_timer;
+static void enqueue (struct work *);
+static struct worker *running_worker (const struct work *);
+
+/* Returns true if workqueue A_ has higher priority than B_. */
+static bool
+priority_more (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct workqueue *a = list_entry (a_, struct workqueue, elem);
+  const struct workqueue *b = list_entry (b_, struct workqueue, elem);
+
+  return a->priority > b->priority;
+}
+
+/* Initializes WQ as a workqueue named NAME whose work runs at
+   PRIORITY.  Work may be queued on WQ right away, but it does
+   not run until workqueue_start() has been called. */
+void
+workqueue_init (struct workqueue *wq, const char *name, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (wq != NULL);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  wq->name = name;
+  wq->priority = priority;
+  list_init (&wq->works);
+  wq->run_cnt = 0;
+  wq->latency_ns = 0;
+  wq->max_latency_ns = 0;
+
+  old_level = intr_disable ();
+  list_insert_ordered (&queues, &wq->elem, priority_more, NULL);
+  intr_set_level (old_level);
+}
+
+/* Starts the worker threads.  Must be called after the
+   scheduler has started. */
+void
+workqueue_start (void)
+{
+  enum intr_level old_level;
+  int i;
+
+  lock_init (&flush_lock);
+  cond_init (&work_done);
+
+  old_level = intr_disable ();
+  sema_init (&work_cnt, early_cnt);
+  started = true;
+  intr_set_level (old_level);
+
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "worker %d", i);
+      thread_create (name, PRI_MAX, worker_thread, &workers[i]);
+    }
+}
+
+/* Initializes WORK to call FUNC, passing AUX. */
+void
+work_init (struct work *work, work_func *func, void *aux)
+{
+  work->func = func;
+  work->aux = aux;
+  work->wq = NULL;
+  work->pending = false;
+}
+
+/* Initializes DWORK to call FUNC, passing AUX. */
+void
+delayed_work_init (struct delayed_work *dwork, work_func *func, void *aux)
+{
+  work_init (&dwork->work, func, aux);
+  timer_setup (&dwork->timer, delayed_work_timer, dwork);
+}
+
+/* Queues WORK on WQ.  Returns true if successful, false if WORK
+   was already pending, in which case it is left alone.  May be
+   called from an interrupt handler. */
+bool
+queue_work (struct workqueue *wq, struct work *work)
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued = !work->pending;
+
+  if (queued)
+    {
+      work->pending = true;
+      work->wq = wq;
+      enqueue (work);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Queues DWORK on WQ after TICKS timer ticks.  Returns true if
+   successful, false if DWORK was already pending, in which case
+   it is left alone.  May be called from an interrupt handler. */
+bool
+queue_delayed_work (struct workqueue *wq, struct delayed_work *dwork,
+                    int64_t ticks)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  if (ticks <= 0)
+    return queue_work (wq, &dwork->work);
+
+  old_level = intr_disable ();
+  queued = !dwork->work.pending;
+  if (queued)
+    {
+      dwork->work.pending = true;
+      dwork->work.wq = wq;
+      timer_add (&dwork->timer, ticks);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Returns true if WORK is pending or running. */
+static bool
+work_busy (const struct work *work)
+{
+  enum intr_level old_level = intr_disable ();
+  bool busy = work->pending || running_worker (work) != NULL;
+  intr_set_level (old_level);
+  return busy;
+}
+
+/* Waits until WORK is neither pending nor running.  Must not be
+   called by WORK itself or from an interrupt handler. */
+void
+flush_work (struct work *work)
+{
+  lock_acquire (&flush_lock);
+  while (work_busy (work))
+    cond_wait (&work_done, &flush_lock);
+  lock_release (&flush_lock);
+}
+
+/* Prints workqueue statistics. */
+void
+workqueue_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&queues); e != list_end (&queues); e = list_next (e))
+    {
+      struct workqueue *wq = list_entry (e, struct workqueue, elem);
+
+      printf ("Workqueue %s: %lld works, latency %"PRId64" us average, "
+              "%"PRId64" us max\n",
+              wq->name, wq->run_cnt,
+              wq->run_cnt > 0 ? wq->latency_ns / wq->run_cnt / 1000 : 0,
+              wq->max_latency_ns / 1000);
+    }
+}
+
+/* Puts pending WORK on its queue, or, if a worker is running it,
+   has the worker put it there when done.  Interrupts must be
+   off. */
+static void
+enqueue (struct work *work)
+{
+  struct worker *w = running_worker (work);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (work->pending);
+
+  if (w != NULL)
+    w->requeue = true;
+  else
+    {
+      work->queued_ns = timer_ns ();
+      list_push_back (&work->wq->works, &work->elem);
+      if (started)
+        sema_up (&work_cnt);
+      else
+        early_cnt++;
+    }
+}
+
+/* Returns the worker running WORK, or a null pointer if none is.
+   Interrupts must be off. */
+static struct worker *
+running_worker (const struct work *work)
+{
+  int i;
+
+  for (i = 0; i < WORKER_CNT; i++)
+    if (workers[i].current == work)
+      return &workers[i];
+  return NULL;
+}
+
+/* Timer function that queues the delayed work passed as
+   DWORK_. */
+static void
+delayed_work_timer (void *dwork_)
+{
+  struct delayed_work *dwork = dwork_;
+
+  enqueue (&dwork->work);
+}
+
+/* Worker thread.  Waits at the highest priority, so that it
+   picks up new work promptly, then drops to the priority of the
+   work's queue to run it. */
+static void
+worker_thread (void *w_)
+{
+  struct worker *w = w_;
+
+  for (;;)
+    {
+      struct workqueue *wq = NULL;
+      struct work *work;
+      struct list_elem *e;
+      int64_t latency;
+
+      sema_down (&work_cnt);
+
+      intr_disable ();
+      for (e = list_begin (&queues); e != list_end (&queues);
+           e = list_next (e))
+        {
+          wq = list_entry (e, struct workqueue, elem);
+          if (!list_empty (&wq->works))
+            break;
+        }
+      ASSERT (e != list_end (&queues));
+      work = list_entry (list_pop_front (&wq->works), struct work, elem);
+      work->pending = false;
+      w->current = work;
+
+      latency = timer_ns () - work->queued_ns;
+      wq->run_cnt++;
+      wq->latency_ns += latency;
+      if (latency > wq->max_latency_ns)
+        wq->max_latency_ns = latency;
+      intr_enable ();
+
+      thread_set_priority (wq->priority);
+      work->func (work->aux);
+      thread_set_priority (PRI_MAX);
+
+      /* WORK may have been freed by now, unless it was queued
+         again. */
+      lock_acquire (&flush_lock);
+      intr_disable ();
+      w->current = NULL;
+      if (w->requeue)
+        {
+          w->requeue = false;
+          enqueue (work);
+        }
+      intr_enable ();
+      cond_broadcast (&work_done, &flush_lock);
+      lock_release (&flush_lock);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Function that does a piece of work. */
+typedef void work_func (void *aux);
+
+/* A piece of work for the worker threads. */
+struct work
+  {
+    struct list_elem elem;      /* Element in workqueue's list. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Argument for FUNC. */
+    struct workqueue *wq;       /* Queue it was last queued on. */
+    bool pending;               /* Queued but not yet started? */
+    int64_t queued_ns;          /* When put on WQ's list. */
+  };
+
+/* Work that is queued after a delay. */
+struct delayed_work
+  {
+    struct work work;           /* The work itself. */
+    struct timer timer;         /* Queues WORK when it fires. */
+  };
+
+/* A queue of work.  Worker threads serve queues in order of
+   priority and run each queue's work at its priority. */
+struct workqueue
+  {
+    const char *name;           /* Name, for statistics. */
+    int priority;               /* Priority to run work at. */
+    struct list works;          /* Pending work, oldest first. */
+    struct list_elem elem;      /* Element in list of all queues. */
+
+    /* Statistics. */
+    long long run_cnt;          /* Number of works started. */
+    int64_t latency_ns;         /* Total time from queue to start. */
+    int64_t max_latency_ns;     /* Longest time from queue to start. */
+  };
+
+void workqueue_init (struct workqueue *, const char *name, int priority);
+void workqueue_start (void);
+
+void work_init (struct work *, work_func *, void *aux);
+void delayed_work_init (struct delayed_work *, work_func *, void *aux);
+bool queue_work (struct workqueue *, struct work *);
+bool queue_delayed_work (struct workqueue *, struct delayed_work *,
+                         int64_t ticks);
+void flush_work (struct work *);
+
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
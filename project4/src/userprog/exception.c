@@ -5,6 +5,10 @@
 #include <user/syscall.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -149,6 +153,29 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Bring in the page from its backing store, if it has one, or
+     grow the stack to cover it.  A fault in the kernel on a user
+     address happens inside a system call, so check it against
+     the stack pointer saved on entry. */
+  if (not_present && fault_addr != NULL && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL)
+    {
+      struct thread *t = thread_current ();
+
+      if (page_in (t, fault_addr)
+          || page_grow_stack (fault_addr,
+                              user ? f->esp : t->syscall_frame->esp))
+        return;
+    }
+
+  /* Copy a page shared copy-on-write when it is first written. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL
+      && page_copy_on_write (thread_current (), fault_addr))
+    return;
+#endif
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
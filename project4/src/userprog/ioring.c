@@ -0,0 +1,371 @@
+#include "userprog/ioring.h"
+#include <debug.h>
+#include <ioring.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Kernel state for a process's registered I/O ring.
+
+   Each ring is drained by work on the "ioring" workqueue, so the
+   owning process pays one trap per batch of requests and can
+   keep computing while a worker thread performs the I/O.  The
+   worker reaches the owner's buffers by translating user
+   addresses through the owner's page directory, which stays
+   alive until ioring_destroy() has waited for the work. */
+struct ioring_ctx
+  {
+    struct thread *owner;       /* Process that registered the ring. */
+    struct ioring *uring;       /* User address of the shared page. */
+    struct ioring *ring;        /* Kernel alias of the shared page. */
+    struct work drain;          /* Drains the submission queue. */
+    struct lock lock;           /* Protects completion waits. */
+    struct condition cq_posted; /* Signaled when a CQE is posted. */
+    bool dying;                 /* Set to stop draining. */
+  };
+
+/* Workqueue for draining rings. */
+static struct workqueue ioring_wq;
+
+static work_func ioring_drain;
+static int ioring_execute (struct ioring_ctx *, const struct ioring_sqe *);
+
+/* Initializes I/O rings. */
+void
+ioring_init (void)
+{
+  workqueue_init (&ioring_wq, "ioring", PRI_DEFAULT);
+}
+
+/* Registers the page-aligned ring at user address URING for the
+   running process.  Returns 0 if successful, -1 if URING is not
+   a writable user page or the process already has a ring. */
+int
+ioring_setup (void *uring)
+{
+  struct thread *cur = thread_current ();
+  struct ioring_ctx *ctx;
+  struct ioring *ring;
+
+  if (cur->ioring != NULL || uring == NULL || pg_ofs (uring) != 0
+      || !is_user_vaddr (uring))
+    return -1;
+#ifdef VM
+  /* The worker uses the kernel alias, so the page must stay put. */
+  ring = page_pin (cur, uring, true);
+  if (ring == NULL)
+    return -1;
+#else
+  if (!pagedir_is_writable (cur->pagedir, uring))
+    return -1;
+  ring = pagedir_get_page (cur->pagedir, uring);
+#endif
+
+  ctx = malloc (sizeof *ctx);
+  if (ctx == NULL)
+    goto error;
+  ctx->owner = cur;
+  ctx->uring = uring;
+  ctx->ring = ring;
+  work_init (&ctx->drain, ioring_drain, ctx);
+  lock_init (&ctx->lock);
+  cond_init (&ctx->cq_posted);
+  ctx->dying = false;
+
+  ring->sq_head = ring->sq_tail = 0;
+  ring->cq_head = ring->cq_tail = 0;
+
+  cur->ioring = ctx;
+  return 0;
+
+ error:
+#ifdef VM
+  page_unpin (cur, uring);
+#endif
+  return -1;
+}
+
+/* Hands all submitted requests in the running process's ring to
+   a worker, then waits until at least MIN_COMPLETE completions
+   are ready to be reaped.  Returns the number of completions
+   ready, or -1 if the process has no ring. */
+int
+ioring_enter (unsigned min_complete)
+{
+  struct ioring_ctx *ctx = thread_current ()->ioring;
+  struct ioring *ring;
+  unsigned ready;
+
+  if (ctx == NULL)
+    return -1;
+  ring = ctx->ring;
+
+  /* Also restarts draining if it stopped on a full completion
+     queue, since the owner has presumably reaped some since. */
+  queue_work (&ioring_wq, &ctx->drain);
+
+  lock_acquire (&ctx->lock);
+  /* Never wait for more completions than there are requests
+     outstanding or unreaped; that would sleep forever. */
+  if (min_complete > ring->sq_tail - ring->cq_head)
+    min_complete = ring->sq_tail - ring->cq_head;
+  if (min_complete > IORING_CQ_ENTRIES)
+    min_complete = IORING_CQ_ENTRIES;
+  while (ring->cq_tail - ring->cq_head < min_complete)
+    cond_wait (&ctx->cq_posted, &ctx->lock);
+  ready = ring->cq_tail - ring->cq_head;
+  lock_release (&ctx->lock);
+
+  return ready;
+}
+
+/* Stops draining T's ring, if any, and releases the ring.  Must
+   be called before T's page directory is destroyed. */
+void
+ioring_destroy (struct thread *t)
+{
+  struct ioring_ctx *ctx = t->ioring;
+
+  if (ctx == NULL)
+    return;
+
+  ctx->dying = true;
+  flush_work (&ctx->drain);
+
+#ifdef VM
+  page_unpin (t, ctx->uring);
+#endif
+  t->ioring = NULL;
+  free (ctx);
+}
+
+/* Posts a completion carrying USER_DATA and RES.  The
+   completion queue must have room for it. */
+static void
+post_completion (struct ioring_ctx *ctx, uint32_t user_data, int res)
+{
+  struct ioring *ring = ctx->ring;
+  struct ioring_cqe *cqe;
+
+  lock_acquire (&ctx->lock);
+  cqe = &ring->cq[ring->cq_tail % IORING_CQ_ENTRIES];
+  cqe->user_data = user_data;
+  cqe->res = res;
+  barrier ();
+  ring->cq_tail++;
+  cond_broadcast (&ctx->cq_posted, &ctx->lock);
+  lock_release (&ctx->lock);
+}
+
+/* Work that drains the submission queue of the ring passed as
+   CTX_.  Stops early if the completion queue fills up, rather
+   than tie up a worker until the owner reaps; the owner's next
+   ioring_enter() queues the work again. */
+static void
+ioring_drain (void *ctx_)
+{
+  struct ioring_ctx *ctx = ctx_;
+  struct ioring *ring = ctx->ring;
+
+  while (!ctx->dying && ring->sq_head != ring->sq_tail
+         && ring->cq_tail - ring->cq_head < IORING_CQ_ENTRIES)
+    {
+      /* Copy the entry out before releasing its slot, so the
+         owner cannot change it underneath us. */
+      struct ioring_sqe sqe = ring->sq[ring->sq_head % IORING_SQ_ENTRIES];
+      barrier ();
+      ring->sq_head++;
+
+      post_completion (ctx, sqe.user_data, ioring_execute (ctx, &sqe));
+    }
+}
+
+/* Returns the kernel virtual address for the owner's user
+   address UADDR, or a null pointer if UADDR is not mapped (or
+   not writable, if WRITABLE is true).  Pages not yet loaded are
+   brought in on the owner's behalf and stay in memory until
+   unpin() is called. */
+static void *
+pin (struct ioring_ctx *ctx, const void *uaddr, bool writable)
+{
+  if (uaddr == NULL || !is_user_vaddr (uaddr))
+    return NULL;
+#ifdef VM
+  return page_pin (ctx->owner, uaddr, writable);
+#else
+  uint32_t *pd = ctx->owner->pagedir;
+
+  if (writable && !pagedir_is_writable (pd, pg_round_down (uaddr)))
+    return NULL;
+  return pagedir_get_page (pd, uaddr);
+#endif
+}
+
+/* Releases the owner's user address UADDR, pinned by pin(). */
+static void
+unpin (struct ioring_ctx *ctx UNUSED, const void *uaddr UNUSED)
+{
+#ifdef VM
+  page_unpin (ctx->owner, uaddr);
+#endif
+}
+
+/* Opens the file named by the owner's string at UNAME. */
+static int
+do_open (struct ioring_ctx *ctx, const char *uname)
+{
+  char name[128];
+  size_t i;
+  int fd;
+
+  for (i = 0; i < sizeof name; i++)
+    {
+      const char *c = pin (ctx, uname + i, false);
+      if (c == NULL)
+        return -1;
+      name[i] = *c;
+      unpin (ctx, uname + i);
+      if (name[i] == '\0')
+        break;
+    }
+  if (i == sizeof name)
+    return -1;
+
+  lock_acquire (&ctx->owner->file_lock);
+  fd = process_open (ctx->owner, name);
+  lock_release (&ctx->owner->file_lock);
+  return fd;
+}
+
+/* Writes SQE's buffer to the console. */
+static int
+do_console_write (struct ioring_ctx *ctx, const struct ioring_sqe *sqe)
+{
+  const uint8_t *uaddr = sqe->addr;
+  size_t left = sqe->len;
+
+  while (left > 0)
+    {
+      size_t chunk = PGSIZE - pg_ofs (uaddr);
+      const char *kaddr = pin (ctx, uaddr, false);
+
+      if (kaddr == NULL)
+        return -1;
+      if (chunk > left)
+        chunk = left;
+      putbuf (kaddr, chunk);
+      unpin (ctx, uaddr);
+      uaddr += chunk;
+      left -= chunk;
+    }
+  return sqe->len;
+}
+
+/* Transfers SQE->len bytes between file SQE->fd and the owner's
+   buffer at SQE->addr, writing to the file if WRITING is true
+   and reading from it otherwise.  Uses SQE->offset if
+   POSITIONAL, the file position otherwise.  The buffer is
+   processed one page at a time, directly through the kernel
+   alias of each user page, pinned while it is in use.  Returns
+   the number of bytes transferred, or -1 on error. */
+static int
+do_transfer (struct ioring_ctx *ctx, const struct ioring_sqe *sqe,
+             bool writing, bool positional)
+{
+  uint8_t *uaddr = sqe->addr;
+  size_t left = sqe->len;
+  off_t ofs = sqe->offset;
+  struct process_file *pf;
+  struct file *file = NULL;
+  int total = 0;
+
+  lock_acquire (&ctx->owner->file_lock);
+  pf = process_get_file (ctx->owner, sqe->fd);
+  if (pf != NULL && !pf->isdir)
+    file = pf->file;
+  else
+    total = -1;
+  while (file != NULL && left > 0)
+    {
+      size_t chunk = PGSIZE - pg_ofs (uaddr);
+      void *kaddr = pin (ctx, uaddr, !writing);
+      off_t n;
+
+      if (kaddr == NULL)
+        {
+          if (total == 0)
+            total = -1;
+          break;
+        }
+      if (chunk > left)
+        chunk = left;
+
+      if (writing)
+        n = (positional ? file_write_at (file, kaddr, chunk, ofs)
+             : file_write (file, kaddr, chunk));
+      else
+        n = (positional ? file_read_at (file, kaddr, chunk, ofs)
+             : file_read (file, kaddr, chunk));
+      unpin (ctx, uaddr);
+
+      total += n;
+      ofs += n;
+      uaddr += n;
+      left -= n;
+      if ((size_t) n < chunk)
+        break;
+    }
+  lock_release (&ctx->owner->file_lock);
+  return total;
+}
+
+/* Performs the request in SQE on behalf of the ring's owner and
+   returns its result. */
+static int
+ioring_execute (struct ioring_ctx *ctx, const struct ioring_sqe *sqe)
+{
+  bool closed;
+
+  switch (sqe->opcode)
+    {
+    case IORING_OP_NOP:
+      return 0;
+
+    case IORING_OP_OPEN:
+      return do_open (ctx, sqe->addr);
+
+    case IORING_OP_READ:
+      /* Keyboard reads would stall every later request behind
+         them, so the console is not readable through the ring. */
+      if (sqe->fd == STDIN_FILENO)
+        return -1;
+      return do_transfer (ctx, sqe, false, false);
+
+    case IORING_OP_WRITE:
+      if (sqe->fd == STDOUT_FILENO)
+        return do_console_write (ctx, sqe);
+      return do_transfer (ctx, sqe, true, false);
+
+    case IORING_OP_PREAD:
+      return do_transfer (ctx, sqe, false, true);
+
+    case IORING_OP_CLOSE:
+      lock_acquire (&ctx->owner->file_lock);
+      closed = process_close_file (ctx->owner, sqe->fd);
+      lock_release (&ctx->owner->file_lock);
+      return closed ? 0 : -1;
+
+    default:
+      return -1;
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef USERPROG_IORING_H
+#define USERPROG_IORING_H
+
+struct thread;
+
+void ioring_init (void);
+int ioring_setup (void *uring);
+int ioring_enter (unsigned min_complete);
+void ioring_destroy (struct thread *);
+
+#endif /* userprog/ioring.h */
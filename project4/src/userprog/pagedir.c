@@ -1,12 +1,18 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* Statistics. */
+static long long cr3_load_cnt;  /* # of page directory loads. */
+static long long cr3_skip_cnt;  /* # of loads skipped as redundant. */
+
 static uint32_t *active_pd (void);
+static void load_pagedir (uint32_t *);
 static void invalidate_pagedir (uint32_t *);
 
 /* Creates a new page directory that has mappings for kernel
@@ -156,6 +162,32 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Returns true if user virtual page UPAGE is mapped read/write
+   in PD, false if it is read-only or unmapped.  A mapping
+   cleared with pagedir_clear_page() keeps its writability,
+   because the page may be mapped again at any time. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *upage) 
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  return pte != NULL && (*pte & PTE_W) != 0;
+}
+
+/* Makes user virtual page UPAGE in PD read/write if WRITABLE
+   is true, read-only otherwise.  UPAGE must be mapped. */
+void
+pagedir_set_writable (uint32_t *pd, const void *upage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+
+  ASSERT (pte != NULL && (*pte & PTE_P) != 0);
+  if (writable)
+    *pte |= PTE_W;
+  else
+    *pte &= ~(uint32_t) PTE_W;
+  invalidate_pagedir (pd);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -222,12 +254,36 @@ pagedir_activate (uint32_t *pd)
   if (pd == NULL)
     pd = init_page_dir;
 
+  /* Loading CR3 flushes the TLB, so don't if PD is already
+     active. */
+  if (pd == active_pd ())
+    {
+      cr3_skip_cnt++;
+      return;
+    }
+  load_pagedir (pd);
+}
+
+/* Prints page directory statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("Page directories: %lld loaded, %lld loads skipped\n",
+          cr3_load_cnt, cr3_skip_cnt);
+}
+
+/* Loads PD into the CPU, flushing all the TLB entries that are
+   not global. */
+static void
+load_pagedir (uint32_t *pd)
+{
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  cr3_load_cnt++;
 }
 
 /* Returns the currently active page directory. */
@@ -256,8 +312,8 @@ invalidate_pagedir (uint32_t *pd)
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
+      /* Re-loading PD clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      load_pagedir (pd);
     } 
 }
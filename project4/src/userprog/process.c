@@ -6,24 +6,51 @@
 #include <stdlib.h>
 #include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/ioring.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+
+// Passed from process_fork() to start_fork()
+struct fork_info {
+  struct thread *parent;
+  struct intr_frame *if_;
+};
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp,
 		  char** save_ptr);
 
+/* Cache of process_file records. */
+static struct kmem_cache *pf_cache;
+
+/* Initializes the process module. */
+void
+process_init (void)
+{
+  pf_cache = kmem_cache_create ("process_file",
+                                sizeof (struct process_file), NULL);
+}
+
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -41,18 +68,161 @@ process_execute (const char *file_name)
     return TID_ERROR;
   strlcpy (fn_copy, file_name, PGSIZE);
 
-  // Get parsed file name
+  // Get parsed file name, leaving the caller's string alone
+  char thread_name[16];
   char *save_ptr;
-  file_name = strtok_r((char *) file_name, " ", &save_ptr);
+  strlcpy (thread_name, file_name, sizeof thread_name);
+  strtok_r (thread_name, " ", &save_ptr);
 
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  tid = thread_create (thread_name, PRI_DEFAULT, start_process, fn_copy);
   if (tid == TID_ERROR)
     palloc_free_page (fn_copy);
 
   return tid;
 }
 
+#ifdef VM
+/* Starts a new process that is a copy of the running process,
+   which is in the system call whose frame is IF_.  The child
+   returns 0 from the system call; the parent gets the child's
+   thread id, or ERROR if the child cannot be created.  Memory is
+   shared copy-on-write, open files are reopened at the same
+   positions, open directories are reopened at their start, and
+   memory mappings and the I/O ring are not inherited.  A process with an I/O ring cannot fork,
+   because the ring's worker writes to its pages behind the
+   copy-on-write machinery's back. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct thread *cur = thread_current();
+  struct fork_info info;
+
+  if (cur->ioring)
+    {
+      return ERROR;
+    }
+  info.parent = cur;
+  info.if_ = if_;
+  tid_t tid = thread_create(cur->name, PRI_DEFAULT, start_fork, &info);
+  struct child_process* cp = get_child_process(tid);
+  if (!cp)
+    {
+      return ERROR;
+    }
+  // Wait for the child to copy us.  We must not run in the
+  // meantime, since the child is reading our state.
+  if (cp->load == NOT_LOADED)
+    {
+      sema_down(&cp->load_sema);
+    }
+  if (cp->load == LOAD_FAIL)
+    {
+      remove_child_process(cp);
+      return ERROR;
+    }
+  return tid;
+}
+
+/* Gives the running process its own handles to PARENT's
+   executable, open files and open directories, with the same
+   file descriptors.  Files keep their positions.  Returns true if successful,
+   false if memory is exhausted. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *cur = thread_current();
+  struct list_elem *e;
+  bool success = true;
+
+  cur->executable = file_reopen(parent->executable);
+  if (!cur->executable)
+    {
+      return false;
+    }
+  file_deny_write(cur->executable);
+
+  lock_acquire(&parent->file_lock);
+  for (e = list_begin(&parent->file_list);
+       success && e != list_end(&parent->file_list); e = list_next(e))
+    {
+      struct process_file *ppf = list_entry(e, struct process_file, elem);
+      struct process_file *pf = kmem_cache_alloc(pf_cache);
+      if (!pf)
+	{
+	  success = false;
+	  break;
+	}
+      *pf = *ppf;
+      if (ppf->isdir)
+	{
+	  pf->dir = dir_reopen(ppf->dir);
+	  success = pf->dir != NULL;
+	}
+      else
+	{
+	  pf->file = file_reopen(ppf->file);
+	  success = pf->file != NULL;
+	  if (success)
+	    {
+	      file_seek(pf->file, file_tell(ppf->file));
+	    }
+	}
+      if (!success)
+	{
+	  kmem_cache_free(pf_cache, pf);
+	  break;
+	}
+      list_push_back(&cur->file_list, &pf->elem);
+    }
+  cur->fd = parent->fd;
+  lock_release(&parent->file_lock);
+  return success;
+}
+
+/* A thread function that copies the process passed in INFO_ and
+   starts the copy running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *cur = thread_current();
+  struct intr_frame if_ = *info->if_;
+
+  // Files first, since the address space refers to our handle
+  // to the executable
+  bool success = fork_files(parent) && page_table_init(cur);
+  if (success)
+    {
+      cur->pagedir = pagedir_create();
+      if (!cur->pagedir)
+	{
+	  page_table_destroy(cur);
+	  success = false;
+	}
+    }
+  if (success)
+    {
+      process_activate();
+      success = page_table_copy(parent);
+    }
+
+  cur->cp->load = success ? LOAD_SUCCESS : LOAD_FAIL;
+  sema_up(&cur->cp->load_sema);
+  if (!success)
+    {
+      thread_exit();
+    }
+
+  // Return to user mode just like our parent will, except that
+  // the system call returns 0
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
@@ -139,8 +309,27 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  // Stop the I/O ring worker first, since it reaches our files
+  // and user pages.  We may be exiting from inside a file system
+  // call, so let the worker finish its request.
+  if (lock_held_by_current_thread(&cur->file_lock))
+    {
+      lock_release(&cur->file_lock);
+    }
+  ioring_destroy(cur);
+
+#ifdef VM
+  // Write back our memory-mapped files, then release our pages
+  // while the executable they may share is still open
+  if (cur->pagedir != NULL)
+    {
+      mmap_unmap_all(cur);
+      page_table_destroy(cur);
+    }
+#endif
+
   // Close all files opened by process
-  process_close_file(CLOSE_ALL);
+  process_close_file(cur, CLOSE_ALL);
   if (cur->executable)
     {
       file_close(cur->executable);
@@ -187,8 +376,13 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  A kernel thread has none of
+     its own, and the kernel mappings are the same in every page
+     directory, so it just keeps whichever one is active.  That
+     one stays valid, because a process always switches to the
+     base page directory before destroying its own. */
+  if (t->pagedir != NULL)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -285,9 +479,18 @@ load (const char *file_name, void (**eip) (void), void **esp,
   int i;
 
   /* Allocate and activate page directory. */
+#ifdef VM
+  if (!page_table_init (t))
+    goto done;
+#endif
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
-    goto done;
+    {
+#ifdef VM
+      page_table_destroy (t);
+#endif
+      goto done;
+    }
   process_activate ();
 
   /* Open executable file. */
@@ -388,7 +591,9 @@ load (const char *file_name, void (**eip) (void), void **esp,
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -448,7 +653,11 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    user process if WRITABLE is true, read-only otherwise.
 
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   or disk read error occurs.
+
+   With virtual memory, the pages are only recorded in the
+   supplemental page table here, and each one is read in when it
+   is first accessed. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
@@ -457,6 +666,22 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!page_add_file (file, ofs, upage, page_read_bytes, writable))
+        return false;
+
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -492,6 +717,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -499,10 +725,21 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, const char* file_name, char** save_ptr) 
 {
-  uint8_t *kpage;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#ifdef VM
+  // The stack page is an ordinary zero page, brought in now to
+  // hold the arguments
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  if (!page_add_file (NULL, 0, upage, 0, true)
+      || !page_in (thread_current (), upage))
+    {
+      return success;
+    }
+  success = true;
+  *esp = PHYS_BASE;
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (!kpage)
     {
       return success;
@@ -515,6 +752,7 @@ setup_stack (void **esp, const char* file_name, char** save_ptr)
       palloc_free_page (kpage);
       return success;
     }
+#endif
 
   char *token;
   char **argv = malloc(DEFAULT_ARGV*sizeof(char *));
@@ -573,6 +811,7 @@ setup_stack (void **esp, const char* file_name, char** save_ptr)
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -592,41 +831,75 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
 
 
-int process_add_dir (struct dir *d)
+int process_add_dir (struct thread *t, struct dir *d)
 {
-  struct process_file *pf = malloc(sizeof(struct process_file));
+  struct process_file *pf = kmem_cache_alloc(pf_cache);
   if (!pf)
     {
       return ERROR;
     }
   pf->dir = d;
   pf->isdir = true;
-  pf->fd = thread_current()->fd;
-  thread_current()->fd++;
-  list_push_back(&thread_current()->file_list, &pf->elem);
+  pf->fd = t->fd;
+  t->fd++;
+  list_push_back(&t->file_list, &pf->elem);
   return pf->fd;
 }
 
-int process_add_file (struct file *f)
+int process_add_file (struct thread *t, struct file *f)
 {
-  struct process_file *pf = malloc(sizeof(struct process_file));
+  struct process_file *pf = kmem_cache_alloc(pf_cache);
   if (!pf)
     {
       return ERROR;
     }
   pf->file = f;
   pf->isdir = false;
-  pf->fd = thread_current()->fd;
-  thread_current()->fd++;
-  list_push_back(&thread_current()->file_list, &pf->elem);
+  pf->fd = t->fd;
+  t->fd++;
+  list_push_back(&t->file_list, &pf->elem);
   return pf->fd;
 }
 
-struct process_file* process_get_file (int fd)
+/* Opens the file or directory NAME, resolved against T's working
+   directory, and adds it to T's file descriptor table.  Returns
+   the new file descriptor, or ERROR. */
+int process_open (struct thread *t, const char *name)
+{
+  struct thread *cur = thread_current();
+  struct dir *cwd = cur->cwd;
+  cur->cwd = t->cwd;
+  struct file *f = filesys_open(name);
+  cur->cwd = cwd;
+  if (!f)
+    {
+      return ERROR;
+    }
+  int fd;
+  if (inode_is_dir(file_get_inode(f)))
+    {
+      fd = process_add_dir(t, (struct dir *) f);
+      if (fd == ERROR)
+	{
+	  dir_close((struct dir *) f);
+	}
+    }
+  else
+    {
+      fd = process_add_file(t, f);
+      if (fd == ERROR)
+	{
+	  file_close(f);
+	}
+    }
+  return fd;
+}
+
+struct process_file* process_get_file (struct thread *t, int fd)
 {
-  struct thread *t = thread_current();
   struct list_elem *e;
 
   for (e = list_begin (&t->file_list); e != list_end (&t->file_list);
@@ -641,10 +914,10 @@ struct process_file* process_get_file (int fd)
   return NULL;
 }
 
-void process_close_file (int fd)
+bool process_close_file (struct thread *t, int fd)
 {
-  struct thread *t = thread_current();
   struct list_elem *next, *e = list_begin(&t->file_list);
+  bool closed = false;
 
   while (e != list_end (&t->file_list))
     {
@@ -661,15 +934,14 @@ void process_close_file (int fd)
 	      file_close(pf->file);
 	    }
 	  list_remove(&pf->elem);
-	  free(pf);
+	  kmem_cache_free(pf_cache, pf);
+	  closed = true;
 	  if (fd != CLOSE_ALL)
 	    {
-	      return;
+	      return closed;
 	    }
 	}
       e = next;
     }
+  return closed;
 }
-
-
-
@@ -2,6 +2,9 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+
+struct intr_frame;
+
 struct process_file {
   struct file *file;
   struct dir *dir;
@@ -9,10 +12,13 @@ struct process_file {
   int fd;
   struct list_elem elem;
 };
-int process_add_dir (struct dir *d);
-int process_add_file (struct file *f);
-struct process_file* process_get_file (int fd);
+int process_add_dir (struct thread *t, struct dir *d);
+int process_add_file (struct thread *t, struct file *f);
+int process_open (struct thread *t, const char *name);
+struct process_file* process_get_file (struct thread *t, int fd);
+void process_init (void);
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
@@ -1,6 +1,8 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <syscall-stat.h>
 #include <user/syscall.h>
 #include "devices/input.h"
 #include "devices/shutdown.h"
@@ -10,167 +12,339 @@
 #include "filesys/filesys.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/cpu.h"
+#include "userprog/gdt.h"
+#include "userprog/ioring.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/tss.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #define MAX_ARGS 3
 #define USER_VADDR_BOTTOM ((void *) 0x08048000)
 
 static void syscall_handler (struct intr_frame *);
 int user_to_kernel_ptr(const void *vaddr);
-void get_arg (struct intr_frame *f, int *arg, int n);
+void copy_in (void *dst, const void *usrc, size_t size);
 void check_valid_ptr (const void *vaddr);
-void check_valid_buffer (void* buffer, unsigned size);
+void check_valid_buffer (const void* buffer, unsigned size, bool writable);
 void check_valid_string (const void* str);
 
+/* Fast system call entry point, in sysenter.S. */
+void syscall_sysenter_entry (void);
+
+/* Called by syscall_sysenter_entry. */
+void syscall_sysenter (struct intr_frame *);
+
+/* Kinds of system call arguments.  The dispatcher validates
+   every pointer argument before calling the implementation, so
+   implementations may dereference them directly. */
+enum arg_kind
+  {
+    ARG_INT,                    /* Plain 32-bit value. */
+    ARG_STRING,                 /* Null-terminated user string. */
+    ARG_BUFFER,                 /* User buffer that the kernel reads. */
+    ARG_OUT_BUFFER              /* User buffer that the kernel writes. */
+  };
+
+/* A system call implementation.  ARG[0] is the first argument,
+   following the system call number.  The return value goes back
+   to the user in %eax. */
+typedef int syscall_func (const int *arg);
+
+/* A system call descriptor. */
+struct syscall
+  {
+    syscall_func *func;                 /* Implementation. */
+    int argc;                           /* Number of arguments. */
+    enum arg_kind kinds[MAX_ARGS];      /* Kind of each argument. */
+    int len_arg;                        /* Index of the buffer's length
+                                           argument, or -1 if the
+                                           buffer is BUF_SIZE bytes. */
+    size_t buf_size;                    /* Fixed buffer size. */
+  };
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait, sys_create,
+  sys_remove, sys_open, sys_filesize, sys_read, sys_write, sys_seek,
+  sys_tell, sys_close, sys_chdir, sys_mkdir, sys_readdir, sys_isdir,
+  sys_inumber, sys_ioring_setup, sys_ioring_enter, sys_syscall_stats;
+#ifdef VM
+static syscall_func sys_mmap, sys_munmap, sys_fork;
+#endif
+
+/* Table of system calls, indexed by system call number.  Null
+   entries are not implemented.  LEN_ARG is spelled out on every
+   entry, since 0 would name the first argument. */
+static const struct syscall syscall_table[SYS_CNT] =
+  {
+    [SYS_HALT] = {sys_halt, 0, {}, -1, 0},
+    [SYS_EXIT] = {sys_exit, 1, {ARG_INT}, -1, 0},
+    [SYS_EXEC] = {sys_exec, 1, {ARG_STRING}, -1, 0},
+    [SYS_WAIT] = {sys_wait, 1, {ARG_INT}, -1, 0},
+    [SYS_CREATE] = {sys_create, 2, {ARG_STRING, ARG_INT}, -1, 0},
+    [SYS_REMOVE] = {sys_remove, 1, {ARG_STRING}, -1, 0},
+    [SYS_OPEN] = {sys_open, 1, {ARG_STRING}, -1, 0},
+    [SYS_FILESIZE] = {sys_filesize, 1, {ARG_INT}, -1, 0},
+    [SYS_READ] = {sys_read, 3, {ARG_INT, ARG_OUT_BUFFER, ARG_INT}, 2, 0},
+    [SYS_WRITE] = {sys_write, 3, {ARG_INT, ARG_BUFFER, ARG_INT}, 2, 0},
+    [SYS_SEEK] = {sys_seek, 2, {ARG_INT, ARG_INT}, -1, 0},
+    [SYS_TELL] = {sys_tell, 1, {ARG_INT}, -1, 0},
+    [SYS_CLOSE] = {sys_close, 1, {ARG_INT}, -1, 0},
+#ifdef VM
+    [SYS_MMAP] = {sys_mmap, 2, {ARG_INT, ARG_INT}, -1, 0},
+    [SYS_MUNMAP] = {sys_munmap, 1, {ARG_INT}, -1, 0},
+    [SYS_FORK] = {sys_fork, 0, {}, -1, 0},
+#endif
+    [SYS_CHDIR] = {sys_chdir, 1, {ARG_STRING}, -1, 0},
+    [SYS_MKDIR] = {sys_mkdir, 1, {ARG_STRING}, -1, 0},
+    [SYS_READDIR] = {sys_readdir, 2, {ARG_INT, ARG_OUT_BUFFER}, -1,
+                     READDIR_MAX_LEN + 1},
+    [SYS_ISDIR] = {sys_isdir, 1, {ARG_INT}, -1, 0},
+    [SYS_INUMBER] = {sys_inumber, 1, {ARG_INT}, -1, 0},
+    [SYS_IORING_SETUP] = {sys_ioring_setup, 1, {ARG_INT}, -1, 0},
+    [SYS_IORING_ENTER] = {sys_ioring_enter, 1, {ARG_INT}, -1, 0},
+    [SYS_SYSCALL_STATS] = {sys_syscall_stats, 2, {ARG_INT, ARG_OUT_BUFFER},
+                           -1, sizeof (struct syscall_stat)},
+  };
+
+/* Per-system call statistics. */
+static struct syscall_stat syscall_stats[SYS_CNT];
+
+/* Cache of child_process records. */
+static struct kmem_cache *child_cache;
+
 void
 syscall_init (void) 
 {
+  child_cache = kmem_cache_create ("child_process",
+                                   sizeof (struct child_process), NULL);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+
+  /* Also accept system calls through SYSENTER, if the CPU has it.
+     SYSEXIT derives the user selectors from SEL_KCSEG, which
+     matches the GDT layout in gdt.c. */
+  if (cpu_has_features (CPUID_SEP))
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_ESP, (uint32_t) tss_esp0_slot ());
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) syscall_sysenter_entry);
+    }
+}
+
+/* Handles a system call made through SYSENTER.  F is laid out
+   exactly as for a system call made with "int $0x30". */
+void
+syscall_sysenter (struct intr_frame *f)
+{
+  syscall_handler (f);
 }
 
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f) 
 {
+  const struct syscall *sc;
   int arg[MAX_ARGS];
-  int esp = user_to_kernel_ptr((const void*) f->esp);
-  switch (* (int *) esp)
+  unsigned number;
+  uint64_t start = rdtsc ();
+  enum intr_level old_level;
+  int i;
+
+  thread_current()->syscall_frame = f;
+
+  /* Fetch the system call number and arguments, one validated
+     copy each. */
+  copy_in(&number, f->esp, sizeof number);
+  if (number >= SYS_CNT || !syscall_table[number].func)
     {
-    case SYS_HALT:
-      {
-	halt(); 
-	break;
-      }
-    case SYS_EXIT:
-      {
-	get_arg(f, &arg[0], 1);
-	exit(arg[0]);
-	break;
-      }
-    case SYS_EXEC:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0]);
-	arg[0] = user_to_kernel_ptr((const void *) arg[0]);
-	f->eax = exec((const char *) arg[0]); 
-	break;
-      }
-    case SYS_WAIT:
-      {
-	get_arg(f, &arg[0], 1);
-	f->eax = wait(arg[0]);
-	break;
-      }
-    case SYS_CREATE:
-      {
-	get_arg(f, &arg[0], 2);
-	check_valid_string((const void *) arg[0]);
-	arg[0] = user_to_kernel_ptr((const void *) arg[0]);
-	f->eax = create((const char *)arg[0], (unsigned) arg[1]);
-	break;
-      }
-    case SYS_REMOVE:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0]);
-	arg[0] = user_to_kernel_ptr((const void *) arg[0]);
-	f->eax = remove((const char *) arg[0]);
-	break;
-      }
-    case SYS_OPEN:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0]);
-	arg[0] = user_to_kernel_ptr((const void *) arg[0]);
-	f->eax = open((const char *) arg[0]);
-	break; 		
-      }
-    case SYS_FILESIZE:
-      {
-	get_arg(f, &arg[0], 1);
-	f->eax = filesize(arg[0]);
-	break;
-      }
-    case SYS_READ:
-      {
-	get_arg(f, &arg[0], 3);
-	check_valid_buffer((void *) arg[1], (unsigned) arg[2]);
-	arg[1] = user_to_kernel_ptr((const void *) arg[1]);
-	f->eax = read(arg[0], (void *) arg[1], (unsigned) arg[2]);
-	break;
-      }
-    case SYS_WRITE:
-      { 
-	get_arg(f, &arg[0], 3);
-	check_valid_buffer((void *) arg[1], (unsigned) arg[2]);
-	arg[1] = user_to_kernel_ptr((const void *) arg[1]);
-	f->eax = write(arg[0], (const void *) arg[1],
-		       (unsigned) arg[2]);
-	break;
-      }
-    case SYS_SEEK:
-      {
-	get_arg(f, &arg[0], 2);
-	seek(arg[0], (unsigned) arg[1]);
-	break;
-      } 
-    case SYS_TELL:
-      { 
-	get_arg(f, &arg[0], 1);
-	f->eax = tell(arg[0]);
-	break;
-      }
-    case SYS_CLOSE:
-      { 
-	get_arg(f, &arg[0], 1);
-	close(arg[0]);
-	break;
-      }
-    case SYS_CHDIR:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0]);
-	arg[0] = user_to_kernel_ptr((const void *) arg[0]);
-	f->eax = chdir((const char *) arg[0]);
-	break;
-      }
-    case SYS_MKDIR:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0]);
-	arg[0] = user_to_kernel_ptr((const void *) arg[0]);
-	f->eax = mkdir((const char *) arg[0]);
-	break;
-      }
-    case SYS_READDIR:
-      {
-	get_arg(f, &arg[0], 2);
-	check_valid_string((const void *) arg[1]);
-	arg[1] = user_to_kernel_ptr((const void *) arg[1]);
-	f->eax = readdir(arg[0], (char *) arg[1]);
-	break;
-      }
-    case SYS_ISDIR:
-      {
-	get_arg(f, &arg[0], 1);
-	f->eax = isdir(arg[0]);
-	break;
-      }
-    case SYS_INUMBER:
-      {
-	get_arg(f, &arg[0], 1);
-	f->eax = inumber(arg[0]);
-	break;
-      }
+      exit(ERROR);
+    }
+  sc = &syscall_table[number];
+  copy_in(arg, (int *) f->esp + 1, sc->argc * sizeof *arg);
+
+  /* Validate pointer arguments. */
+  for (i = 0; i < sc->argc; i++)
+    {
+      if (sc->kinds[i] == ARG_STRING)
+	{
+	  check_valid_string((const void *) arg[i]);
+	}
+      else if (sc->kinds[i] != ARG_INT)
+	{
+	  check_valid_buffer((const void *) arg[i],
+			     sc->len_arg >= 0 ? (size_t) arg[sc->len_arg]
+			     : sc->buf_size,
+			     sc->kinds[i] == ARG_OUT_BUFFER);
+	}
     }
+
+  old_level = intr_disable();
+  syscall_stats[number].count++;
+  intr_set_level(old_level);
+
+  f->eax = sc->func(arg);
+
+  old_level = intr_disable();
+  syscall_stats[number].cycles += rdtsc() - start;
+  intr_set_level(old_level);
+}
+
+/* System call descriptors' implementations, which unpack ARG
+   for the functions below. */
+
+static int sys_halt (const int *arg UNUSED)
+{
+  halt();
+}
+
+static int sys_exit (const int *arg)
+{
+  exit(arg[0]);
+}
+
+static int sys_exec (const int *arg)
+{
+  return exec((const char *) arg[0]);
+}
+
+static int sys_wait (const int *arg)
+{
+  return wait(arg[0]);
+}
+
+static int sys_create (const int *arg)
+{
+  return create((const char *) arg[0], (unsigned) arg[1]);
+}
+
+static int sys_remove (const int *arg)
+{
+  return remove((const char *) arg[0]);
+}
+
+static int sys_open (const int *arg)
+{
+  return open((const char *) arg[0]);
+}
+
+static int sys_filesize (const int *arg)
+{
+  return filesize(arg[0]);
+}
+
+static int sys_read (const int *arg)
+{
+  return read(arg[0], (void *) arg[1], (unsigned) arg[2]);
+}
+
+static int sys_write (const int *arg)
+{
+  return write(arg[0], (const void *) arg[1], (unsigned) arg[2]);
+}
+
+static int sys_seek (const int *arg)
+{
+  seek(arg[0], (unsigned) arg[1]);
+  return 0;
+}
+
+static int sys_tell (const int *arg)
+{
+  return tell(arg[0]);
+}
+
+static int sys_close (const int *arg)
+{
+  close(arg[0]);
+  return 0;
+}
+
+#ifdef VM
+static int sys_mmap (const int *arg)
+{
+  // The address is only mapped, never dereferenced, so it is
+  // passed as a plain value and checked by mmap_map()
+  return mmap_map(arg[0], (void *) arg[1]);
+}
+
+static int sys_munmap (const int *arg)
+{
+  mmap_unmap(arg[0]);
+  return 0;
+}
+
+static int sys_fork (const int *arg UNUSED)
+{
+  return process_fork(thread_current()->syscall_frame);
+}
+#endif
+
+static int sys_chdir (const int *arg)
+{
+  return chdir((const char *) arg[0]);
+}
+
+static int sys_mkdir (const int *arg)
+{
+  return mkdir((const char *) arg[0]);
+}
+
+static int sys_readdir (const int *arg)
+{
+  return readdir(arg[0], (char *) arg[1]);
+}
+
+static int sys_isdir (const int *arg)
+{
+  return isdir(arg[0]);
+}
+
+static int sys_inumber (const int *arg)
+{
+  return inumber(arg[0]);
+}
+
+static int sys_ioring_setup (const int *arg)
+{
+  /* ioring_setup() validates the ring itself, reporting errors
+     instead of killing the process. */
+  return ioring_setup((void *) arg[0]);
+}
+
+static int sys_ioring_enter (const int *arg)
+{
+  return ioring_enter((unsigned) arg[0]);
+}
+
+static int sys_syscall_stats (const int *arg)
+{
+  unsigned number = arg[0];
+  struct syscall_stat *stat = (struct syscall_stat *) arg[1];
+  enum intr_level old_level;
+
+  if (number >= SYS_CNT)
+    {
+      return ERROR;
+    }
+  old_level = intr_disable();
+  *stat = syscall_stats[number];
+  intr_set_level(old_level);
+  return 0;
 }
 
 bool chdir (const char* dir)
 {
-  return filesys_chdir(dir);
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  bool success = filesys_chdir(dir);
+  lock_release(&t->file_lock);
+  return success;
 }
 
 bool mkdir (const char* dir)
@@ -180,48 +354,39 @@ bool mkdir (const char* dir)
 
 bool readdir (int fd, char* name)
 {
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
-    {
-      return false;
-    }
-  if (!pf->isdir)
-    {
-      return false;
-    }
-  if (!dir_readdir(pf->dir, name))
-    {
-      return false;
-    }
-  return true;
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  bool success = pf && pf->isdir && dir_readdir(pf->dir, name);
+  lock_release(&t->file_lock);
+  return success;
 }
 
 bool isdir (int fd)
 {
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
-    {
-      return ERROR;
-    }
-  return pf->isdir;
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  int isdir = pf ? pf->isdir : ERROR;
+  lock_release(&t->file_lock);
+  return isdir;
 }
 
 int inumber (int fd)
 {
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
-    {
-      return ERROR;
-    }
-  block_sector_t inumber;
-  if (pf->isdir)
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  int inumber = ERROR;
+  if (pf && pf->isdir)
     {
       inumber = inode_get_inumber(dir_get_inode(pf->dir));
     }
-  else
+  else if (pf)
     {
       inumber = inode_get_inumber(file_get_inode(pf->file));
     }
+  lock_release(&t->file_lock);
   return inumber;
 }
 
@@ -278,35 +443,24 @@ bool remove (const char *file)
 
 int open (const char *file)
 {
-  struct file *f = filesys_open(file);
-  if (!f)
-    {
-      return ERROR;
-    }
-  int fd;
-  if (inode_is_dir(file_get_inode(f)))
-    {
-      fd = process_add_dir((struct dir *) f);
-    }
-  else
-    {
-      fd = process_add_file(f);
-    }
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  int fd = process_open(t, file);
+  lock_release(&t->file_lock);
   return fd;
 }
 
 int filesize (int fd)
 {
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
-    {
-      return ERROR;
-    }
-  if (pf->isdir)
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  int size = ERROR;
+  if (pf && !pf->isdir)
     {
-      return ERROR;
+      size = file_length(pf->file);
     }
-  int size = file_length(pf->file);
+  lock_release(&t->file_lock);
   return size;
 }
 
@@ -322,16 +476,15 @@ int read (int fd, void *buffer, unsigned size)
 	}
       return size;
     }
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  int bytes = ERROR;
+  if (pf && !pf->isdir)
     {
-      return ERROR;
+      bytes = file_read(pf->file, buffer, size);
     }
-  if (pf->isdir)
-    {
-      return ERROR;
-    }
-  int bytes = file_read(pf->file, buffer, size);
+  lock_release(&t->file_lock);
   return bytes;
 }
 
@@ -342,51 +495,50 @@ int write (int fd, const void *buffer, unsigned size)
       putbuf(buffer, size);
       return size;
     }
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  int bytes = ERROR;
+  if (pf && !pf->isdir)
     {
-      return ERROR;
+      bytes = file_write(pf->file, buffer, size);
     }
-  if (pf->isdir)
-    {
-      return ERROR;
-    }
-  int bytes = file_write(pf->file, buffer, size);
+  lock_release(&t->file_lock);
   return bytes;
 }
 
 void seek (int fd, unsigned position)
 {
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
-    {
-      return;
-    }
-  if (pf->isdir)
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  if (pf && !pf->isdir)
     {
-      return;
+      file_seek(pf->file, position);
     }
-  file_seek(pf->file, position);
+  lock_release(&t->file_lock);
 }
 
 unsigned tell (int fd)
 {
-  struct process_file *pf = process_get_file(fd);
-  if (!pf)
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  struct process_file *pf = process_get_file(t, fd);
+  off_t offset = ERROR;
+  if (pf && !pf->isdir)
     {
-      return ERROR;
+      offset = file_tell(pf->file);
     }
-  if (pf->isdir)
-    {
-      return ERROR;
-    }
-  off_t offset = file_tell(pf->file);
+  lock_release(&t->file_lock);
   return offset;
 }
 
 void close (int fd)
 {
-  process_close_file(fd);
+  struct thread *t = thread_current();
+  lock_acquire(&t->file_lock);
+  process_close_file(t, fd);
+  lock_release(&t->file_lock);
 }
 
 void check_valid_ptr (const void *vaddr)
@@ -400,7 +552,16 @@ void check_valid_ptr (const void *vaddr)
 int user_to_kernel_ptr(const void *vaddr)
 {
   check_valid_ptr(vaddr);
-  void *ptr = pagedir_get_page(thread_current()->pagedir, vaddr);
+  struct thread *t = thread_current();
+  void *ptr = pagedir_get_page(t->pagedir, vaddr);
+#ifdef VM
+  // Bring in pages that are not loaded yet, and grow the stack
+  // if VADDR is just below it
+  if (!ptr && (page_in(t, vaddr) || page_grow_stack(vaddr, t->syscall_frame->esp)))
+    {
+      ptr = pagedir_get_page(t->pagedir, vaddr);
+    }
+#endif
   if (!ptr)
     {
       exit(ERROR);
@@ -410,7 +571,7 @@ int user_to_kernel_ptr(const void *vaddr)
 
 struct child_process* add_child_process (int pid)
 {
-  struct child_process* cp = malloc(sizeof(struct child_process));
+  struct child_process* cp = kmem_cache_alloc(child_cache);
   if (!cp)
     {
       return NULL;
@@ -446,7 +607,7 @@ struct child_process* get_child_process (int pid)
 void remove_child_process (struct child_process *cp)
 {
   list_remove(&cp->elem);
-  free(cp);
+  kmem_cache_free(child_cache, cp);
 }
 
 void remove_child_processes (void)
@@ -460,38 +621,57 @@ void remove_child_processes (void)
       struct child_process *cp = list_entry (e, struct child_process,
 					     elem);
       list_remove(&cp->elem);
-      free(cp);
+      kmem_cache_free(child_cache, cp);
       e = next;
     }
 }
 
-void get_arg (struct intr_frame *f, int *arg, int n)
+void copy_in (void *dst, const void *usrc, size_t size)
 {
-  int i;
-  int *ptr;
-  for (i = 0; i < n; i++)
-    {
-      ptr = (int *) f->esp + i + 1;
-      check_valid_ptr((const void *) ptr);
-      arg[i] = *ptr;
-    }
+  check_valid_buffer(usrc, size, false);
+  memcpy(dst, usrc, size);
 }
 
-void check_valid_buffer (void* buffer, unsigned size)
+void check_valid_buffer (const void* buffer, unsigned size, bool writable)
 {
-  unsigned i;
-  char* local_buffer = (char *) buffer;
-  for (i = 0; i < size; i++)
+  const uint8_t *upage, *last;
+  if (size == 0)
+    {
+      return;
+    }
+  last = (const uint8_t *) buffer + size - 1;
+  if (last < (const uint8_t *) buffer)
     {
-      check_valid_ptr((const void*) local_buffer);
-      local_buffer++;
+      exit(ERROR);
+    }
+  for (upage = pg_round_down(buffer); upage <= last; upage += PGSIZE)
+    {
+      user_to_kernel_ptr(upage < (const uint8_t *) buffer ? buffer : upage);
+      if (writable && !pagedir_is_writable(thread_current()->pagedir, upage))
+	{
+#ifdef VM
+	  // Take our own copy of a page shared copy-on-write now,
+	  // since the kernel's own writes do not fault on it
+	  if (page_copy_on_write(thread_current(), upage))
+	    {
+	      continue;
+	    }
+#endif
+	  exit(ERROR);
+	}
     }
 }
 
 void check_valid_string (const void* str)
 {
-  while (* (char *) user_to_kernel_ptr(str) != 0)
+  while (true)
     {
-      str = (char *) str + 1;
+      const char *kstr = (const char *) user_to_kernel_ptr(str);
+      size_t left = PGSIZE - pg_ofs(str);
+      if (memchr(kstr, '\0', left))
+	{
+	  return;
+	}
+      str = (const char *) str + left;
     }
 }
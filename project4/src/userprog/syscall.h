@@ -26,7 +26,7 @@ struct child_process* get_child_process (int pid);
 void remove_child_process (struct child_process *cp);
 void remove_child_processes (void);
 
-void process_close_file (int fd);
+bool process_close_file (struct thread *t, int fd);
 
 void syscall_init (void);
 
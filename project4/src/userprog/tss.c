@@ -104,3 +104,13 @@ tss_update (void)
   ASSERT (tss != NULL);
   tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
 }
+
+/* Returns the address of the TSS's ring 0 stack pointer, which
+   always holds the top of the running thread's kernel stack.
+   The sysenter entry path loads its stack pointer from here. */
+void **
+tss_esp0_slot (void) 
+{
+  ASSERT (tss != NULL);
+  return &tss->esp0;
+}
@@ -0,0 +1,240 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* A physical frame holding a user page.
+
+   Frames are indexed by physical page number, so the frame for
+   a kernel address can be found without searching.  Only frames
+   from the user pool are ever in use. */
+struct frame
+  {
+    bool in_use;                /* Allocated by frame_alloc()? */
+    bool pinned;                /* Exempt from eviction? */
+    int map_cnt;                /* Number of pages sharing the frame. */
+    struct thread *thread;      /* Process that maps PAGE. */
+    struct page *page;          /* Page held, or null if shared. */
+  };
+
+/* Frame table. */
+static struct frame *frames;
+static size_t frame_cnt;
+static struct lock frame_lock;  /* Protects allocation and the hand. */
+static size_t hand;             /* Clock hand, an index into FRAMES. */
+
+/* Statistics. */
+static long long evict_cnt;     /* # of frames taken from a page. */
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  frame_cnt = init_ram_pages;
+  frames = calloc (frame_cnt, sizeof *frames);
+  if (frames == NULL)
+    PANIC ("out of memory allocating frame table");
+  lock_init (&frame_lock);
+}
+
+/* Returns the frame for kernel page KPAGE. */
+static struct frame *
+frame_lookup (void *kpage)
+{
+  size_t idx = vtop (kpage) >> PGBITS;
+
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (idx < frame_cnt);
+  return &frames[idx];
+}
+
+/* Tries to lock F's owner's page table, which the caller may
+   already hold.  Returns true if the lock is held afterward, and
+   stores into *ACQUIRED whether this call acquired it. */
+static bool
+lock_owner (struct frame *f, bool *acquired)
+{
+  struct lock *lock = &f->thread->pages_lock;
+
+  *acquired = false;
+  if (lock_held_by_current_thread (lock))
+    return true;
+  *acquired = lock_try_acquire (lock);
+  return *acquired;
+}
+
+/* Picks a frame to evict with the clock algorithm and evicts it,
+   leaving it pinned.  Pages accessed since the hand last passed
+   them get a second chance.  Frames that are pinned, shared, or
+   whose owner is busy with its page table are skipped, because
+   waiting for the owner could deadlock.  Returns a null pointer
+   if no frame could be evicted.  frame_lock must be held. */
+static struct frame *
+evict (void)
+{
+  size_t i;
+
+  /* Two sweeps clear every accessed bit, so a third sweep finds a
+     victim unless nothing is evictable. */
+  for (i = 0; i < 3 * frame_cnt; i++)
+    {
+      struct frame *f = &frames[hand];
+      bool acquired;
+
+      hand = (hand + 1) % frame_cnt;
+      if (!f->in_use || f->pinned || f->page == NULL
+          || !lock_owner (f, &acquired))
+        continue;
+
+      /* Pins only change under the owner's lock, so check again
+         now that we hold it. */
+      if (!f->pinned)
+        {
+          if (pagedir_is_accessed (f->thread->pagedir, f->page->upage))
+            pagedir_set_accessed (f->thread->pagedir, f->page->upage, false);
+          else
+            {
+              f->pinned = true;
+              page_evict (f->thread, f->page);
+              if (acquired)
+                lock_release (&f->thread->pages_lock);
+              evict_cnt++;
+              return f;
+            }
+        }
+      if (acquired)
+        lock_release (&f->thread->pages_lock);
+    }
+  return NULL;
+}
+
+/* Obtains a frame to hold page P of process T, which the caller
+   will map, or a shared frame if P is null.  If the
+   user pool is exhausted, a frame is evicted from some process
+   to make room.  The new frame is pinned: it will not be evicted
+   until frame_unpin() is called, and shared frames should never
+   be unpinned.  Returns the frame's kernel address, or a null
+   pointer if no frame could be obtained. */
+void *
+frame_alloc (struct thread *t, struct page *p)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    {
+      f = frame_lookup (kpage);
+      f->in_use = true;
+    }
+  else
+    {
+      f = evict ();
+      if (f != NULL)
+        kpage = ptov ((f - frames) * PGSIZE);
+    }
+  if (f != NULL)
+    {
+      f->pinned = true;
+      f->map_cnt = 1;
+      f->thread = p != NULL ? t : NULL;
+      f->page = p;
+    }
+  lock_release (&frame_lock);
+
+  return kpage;
+}
+
+/* Drops a reference to frame KPAGE, which the caller must no
+   longer map, and frees the frame if it was the last one. */
+void
+frame_free (void *kpage)
+{
+  struct frame *f = frame_lookup (kpage);
+
+  lock_acquire (&frame_lock);
+  ASSERT (f->in_use);
+  if (--f->map_cnt == 0)
+    {
+      f->in_use = false;
+      f->page = NULL;
+      palloc_free_page (kpage);
+    }
+  lock_release (&frame_lock);
+}
+
+/* Adds a reference to frame KPAGE, which is about to be mapped
+   by one more page.  A frame shared this way is never evicted,
+   until a page claims it again with frame_claim(). */
+void
+frame_share (void *kpage)
+{
+  struct frame *f = frame_lookup (kpage);
+
+  lock_acquire (&frame_lock);
+  ASSERT (f->in_use);
+  f->map_cnt++;
+  f->thread = NULL;
+  f->page = NULL;
+  lock_release (&frame_lock);
+}
+
+/* If page P of process T holds the only reference to frame KPAGE,
+   makes the frame belong to P again, unpinned, and returns true.
+   Returns false if the frame is still shared. */
+bool
+frame_claim (void *kpage, struct thread *t, struct page *p)
+{
+  struct frame *f = frame_lookup (kpage);
+  bool claimed;
+
+  lock_acquire (&frame_lock);
+  ASSERT (f->in_use);
+  claimed = f->map_cnt == 1;
+  if (claimed)
+    {
+      f->pinned = false;
+      f->thread = t;
+      f->page = p;
+    }
+  lock_release (&frame_lock);
+  return claimed;
+}
+
+/* Keeps frame KPAGE from being evicted.  The caller must hold the
+   page table lock of the frame's owner. */
+void
+frame_pin (void *kpage)
+{
+  struct frame *f = frame_lookup (kpage);
+
+  ASSERT (lock_held_by_current_thread (&f->thread->pages_lock));
+  f->pinned = true;
+}
+
+/* Makes frame KPAGE evictable again.  The caller must hold the
+   page table lock of the frame's owner. */
+void
+frame_unpin (void *kpage)
+{
+  struct frame *f = frame_lookup (kpage);
+
+  ASSERT (lock_held_by_current_thread (&f->thread->pages_lock));
+  ASSERT (f->page != NULL);
+  f->pinned = false;
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld evicted\n", evict_cnt);
+}
@@ -0,0 +1,18 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+
+struct page;
+struct thread;
+
+void frame_init (void);
+void *frame_alloc (struct thread *, struct page *);
+void frame_free (void *kpage);
+void frame_share (void *kpage);
+bool frame_claim (void *kpage, struct thread *, struct page *);
+void frame_pin (void *kpage);
+void frame_unpin (void *kpage);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,131 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* A file mapped into a process's address space with mmap(). */
+struct mapping
+  {
+    int id;                     /* Mapping identifier. */
+    struct file *file;          /* Private handle to the file. */
+    uint8_t *base;              /* First mapped user page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+    struct list_elem elem;      /* Element in thread's `mappings'. */
+  };
+
+/* Removes the first PAGE_CNT pages of mapping M from the running
+   process's address space, writing back modified pages. */
+static void
+remove_pages (struct mapping *m, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+}
+
+/* Maps the file open as FD into the running process's address
+   space at ADDR, which must be page-aligned and nonnull, and
+   returns a new mapping identifier.  Returns -1 if FD is not an
+   open, nonempty file or if any page of the mapping would
+   overlap memory already in use. */
+int
+mmap_map (int fd, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  struct process_file *pf;
+  struct file *file;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+
+  /* Use our own handle, so that the mapping stays valid if the
+     process closes FD. */
+  lock_acquire (&t->file_lock);
+  pf = process_get_file (t, fd);
+  file = pf != NULL && !pf->isdir ? file_reopen (pf->file) : NULL;
+  lock_release (&t->file_lock);
+  length = file != NULL ? file_length (file) : 0;
+  if (length == 0
+      || !is_user_vaddr ((uint8_t *) addr + length - 1)
+      || (uint8_t *) addr + length < (uint8_t *) addr)
+    goto error;
+
+  m->id = t->next_mapid++;
+  m->file = file;
+  m->base = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap (file, ofs, m->base + ofs, read_bytes))
+        {
+          remove_pages (m, i);
+          goto error;
+        }
+    }
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+
+ error:
+  file_close (file);
+  free (m);
+  return -1;
+}
+
+/* Unmaps mapping M of the running process, writing back modified
+   pages, and frees it. */
+static void
+unmap (struct mapping *m)
+{
+  list_remove (&m->elem);
+  remove_pages (m, m->page_cnt);
+
+  file_close (m->file);
+  free (m);
+}
+
+/* Unmaps the running process's mapping MAPID, if it exists. */
+void
+mmap_unmap (int mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        {
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps all of T's mappings.  T must be the running thread. */
+void
+mmap_unmap_all (struct thread *t)
+{
+  ASSERT (t == thread_current ());
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
@@ -0,0 +1,10 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+struct thread;
+
+int mmap_map (int fd, void *addr);
+void mmap_unmap (int mapid);
+void mmap_unmap_all (struct thread *);
+
+#endif /* vm/mmap.h */
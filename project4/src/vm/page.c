@@ -0,0 +1,566 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+
+/* Maximum size of a user stack, in pages.  Set with -sl. */
+size_t stack_page_limit = 2048;
+
+/* Statistics. */
+static long long registered_cnt; /* # of pages mapped lazily. */
+static long long loaded_cnt;     /* # of pages actually brought in. */
+static long long fork_cnt;       /* # of frames shared by fork. */
+static long long cow_cnt;        /* # of frames copied on write. */
+
+/* Cache of supplemental page table entries. */
+static struct kmem_cache *page_cache;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static void page_release (struct page *, void *kpage);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  page_cache = kmem_cache_create ("page", sizeof (struct page), NULL);
+}
+
+/* Initializes T's supplemental page table.  Returns true if
+   successful, false if memory allocation failed. */
+bool
+page_table_init (struct thread *t)
+{
+  lock_init (&t->pages_lock);
+  return hash_init (&t->pages, page_hash, page_less, NULL);
+}
+
+/* Lets go of P's frame KPAGE, which is not mapped. */
+static void
+page_release (struct page *p, void *kpage)
+{
+  if (p->shared)
+    share_put (p->file, p->ofs, p->read_bytes);
+  else
+    frame_free (kpage);
+}
+
+/* Writes the contents of memory-mapped page P, which is in frame
+   KPAGE, back to its file, through the buffer cache. */
+static void
+page_write_back (struct page *p, void *kpage)
+{
+  ASSERT (p->mapped);
+
+  file_write_at (p->file, kpage, p->read_bytes, p->ofs);
+  p->dirty = false;
+}
+
+/* Unmaps page P from the running process's page directory and
+   frees its frame and swap slot, first writing it back to its
+   file if it is a modified memory-mapped page.  Does not free
+   P itself. */
+static void
+page_discard (struct page *p)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+
+  if (p->kpage != NULL)
+    {
+      pagedir_clear_page (pd, p->upage);
+      if (p->mapped && (p->dirty || pagedir_is_dirty (pd, p->upage)))
+        page_write_back (p, p->kpage);
+      page_release (p, p->kpage);
+      p->kpage = NULL;
+    }
+  if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+}
+
+/* Frees the page structure in hash element E, along with its
+   frame and swap slot. */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+
+  page_discard (p);
+  kmem_cache_free (page_cache, p);
+}
+
+/* Destroys T's supplemental page table and frees all of its
+   pages.  T must be the running thread, with its page directory
+   still in place, and must still have its executable open,
+   because shared pages are identified by the executable's
+   inode. */
+void
+page_table_destroy (struct thread *t)
+{
+  ASSERT (t == thread_current ());
+
+  lock_acquire (&t->pages_lock);
+  hash_destroy (&t->pages, page_destructor);
+  lock_release (&t->pages_lock);
+}
+
+/* Adds UPAGE to the running process's supplemental page table,
+   backed by FILE as described for page_add_file().  If MAPPED is
+   true, the page is written back to FILE instead of to swap.
+   Returns true if successful, false if UPAGE is already mapped
+   or memory allocation failed. */
+static bool
+page_add (struct file *file, off_t ofs, void *upage, size_t read_bytes,
+          bool writable, bool mapped)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool success;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->writable = writable;
+  p->kpage = NULL;
+  p->shared = false;
+  p->dirty = false;
+  p->swap_slot = SWAP_NONE;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->mapped = mapped;
+  p->cow = false;
+
+  lock_acquire (&t->pages_lock);
+  success = hash_insert (&t->pages, &p->hash_elem) == NULL;
+  lock_release (&t->pages_lock);
+  if (!success)
+    kmem_cache_free (page_cache, p);
+  else
+    registered_cnt++;
+  return success;
+}
+
+/* Records that user page UPAGE in the running process is to be
+   filled with READ_BYTES bytes read from FILE at offset OFS,
+   followed by zeroes, when it is first accessed.  Returns true
+   if successful, false if UPAGE is already mapped or memory
+   allocation failed. */
+bool
+page_add_file (struct file *file, off_t ofs, void *upage,
+               size_t read_bytes, bool writable)
+{
+  return page_add (file, ofs, upage, read_bytes, writable, false);
+}
+
+/* Maps user page UPAGE in the running process to the READ_BYTES
+   bytes of FILE at offset OFS, which must be nonzero.  The page
+   is read from FILE when it is first accessed, and modifications
+   are written back to FILE when it is evicted or unmapped.
+   Returns true if successful, false if UPAGE is already mapped
+   or memory allocation failed. */
+bool
+page_add_mmap (struct file *file, off_t ofs, void *upage, size_t read_bytes)
+{
+  ASSERT (read_bytes > 0);
+  return page_add (file, ofs, upage, read_bytes, true, true);
+}
+
+/* Returns T's page containing user address UADDR, or a null
+   pointer if there is none.  T's pages_lock must be held. */
+static struct page *
+page_lookup (struct thread *t, const void *uaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&t->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Extends the running process's stack with a zeroed page
+   covering user address UADDR, if UADDR looks like a stack
+   access given user stack pointer ESP, and brings the page in.
+   PUSHA writes 32 bytes below the stack pointer before it moves
+   it, so accesses that far below ESP count.  Returns true if
+   successful, false if UADDR is not a stack access, would make
+   the stack exceed stack_page_limit pages, or memory is
+   exhausted. */
+bool
+page_grow_stack (const void *uaddr, const void *esp)
+{
+  uint8_t *upage = pg_round_down (uaddr);
+
+  if (!is_user_vaddr (uaddr)
+      || (const uint8_t *) uaddr + 32 < (const uint8_t *) esp
+      || (size_t) ((uint8_t *) PHYS_BASE - upage) / PGSIZE > stack_page_limit)
+    return false;
+  return (page_add (NULL, 0, upage, 0, true, false)
+          && page_in (thread_current (), upage));
+}
+
+/* Removes page UPAGE from the running process's address space,
+   writing it back to its file first if it is a modified
+   memory-mapped page. */
+void
+page_remove (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, upage);
+  if (p != NULL)
+    {
+      hash_delete (&t->pages, &p->hash_elem);
+      page_discard (p);
+      kmem_cache_free (page_cache, p);
+    }
+  lock_release (&t->pages_lock);
+}
+
+/* Fills KPAGE with READ_BYTES bytes read from FILE at offset
+   OFS, followed by zeroes.  Returns true if successful, false if
+   the file is too short. */
+bool
+page_read_file (struct file *file, off_t ofs, void *kpage,
+                size_t read_bytes)
+{
+  if (read_bytes > 0
+      && file_read_at (file, kpage, read_bytes, ofs) != (off_t) read_bytes)
+    return false;
+  memset ((uint8_t *) kpage + read_bytes, 0, PGSIZE - read_bytes);
+  return true;
+}
+
+/* Brings P's contents into a frame and maps it into T's page
+   directory.  Read-only file pages share a frame with any other
+   process mapping the same data; other frames are left pinned
+   for the caller to unpin.  T's pages_lock must be held.
+   Returns true if successful. */
+static bool
+page_load (struct thread *t, struct page *p)
+{
+  uint8_t *kpage;
+
+  p->shared = !p->writable && p->file != NULL;
+  if (p->shared)
+    kpage = share_get (p->file, p->ofs, p->read_bytes);
+  else
+    {
+      kpage = frame_alloc (t, p);
+      if (kpage == NULL)
+        return false;
+      if (p->swap_slot != SWAP_NONE)
+        {
+          swap_in (p->swap_slot, kpage);
+          p->swap_slot = SWAP_NONE;
+        }
+      else if (!page_read_file (p->file, p->ofs, kpage, p->read_bytes))
+        {
+          frame_free (kpage);
+          return false;
+        }
+    }
+  if (kpage == NULL)
+    return false;
+
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    {
+      page_release (p, kpage);
+      return false;
+    }
+  p->kpage = kpage;
+  loaded_cnt++;
+  return true;
+}
+
+/* Evicts page P of process T from its frame.  A modified
+   memory-mapped page is written back to its file; any other page
+   whose contents can no longer be recreated from its file or
+   from zeroes is written to swap.  T's pages_lock must be held.
+
+   Writing back goes through the buffer cache, whose locks are
+   never held while waiting for a frame, so this cannot
+   deadlock with the file system. */
+void
+page_evict (struct thread *t, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&t->pages_lock));
+  ASSERT (p->kpage != NULL && !p->shared && !p->cow);
+
+  /* Unmap the page before checking the dirty bit, so that the
+     process cannot modify it after we look. */
+  pagedir_clear_page (t->pagedir, p->upage);
+  if (p->dirty || pagedir_is_dirty (t->pagedir, p->upage))
+    {
+      if (p->mapped)
+        page_write_back (p, p->kpage);
+      else
+        {
+          p->dirty = true;
+          p->swap_slot = swap_out (p->kpage);
+        }
+    }
+  p->kpage = NULL;
+}
+
+/* Gives process T a private, writable copy of page P if P is
+   shared copy-on-write, copying the frame unless T turns out to
+   be the last process mapping it.  T's pages_lock must be held.
+   Returns true if successful, false if memory is exhausted. */
+static bool
+page_break_cow (struct thread *t, struct page *p)
+{
+  void *kpage;
+
+  if (!p->cow)
+    return true;
+
+  kpage = p->kpage;
+  if (!frame_claim (kpage, t, p))
+    {
+      kpage = frame_alloc (t, p);
+      if (kpage == NULL)
+        return false;
+      memcpy (kpage, p->kpage, PGSIZE);
+      frame_free (p->kpage);
+      frame_unpin (kpage);
+      cow_cnt++;
+    }
+
+  pagedir_clear_page (t->pagedir, p->upage);
+  pagedir_set_page (t->pagedir, p->upage, kpage, true);
+  p->kpage = kpage;
+  p->cow = false;
+  p->dirty = true;
+  return true;
+}
+
+/* Handles a write to the page containing user address UADDR in
+   process T that faulted because the page is mapped read-only.
+   Returns true if the page is writable copy-on-write and now
+   belongs to T alone, false if the page is read-only, is not
+   part of T's address space, or cannot be copied. */
+bool
+page_copy_on_write (struct thread *t, const void *uaddr)
+{
+  struct page *p;
+  bool success;
+
+  if (!is_user_vaddr (uaddr))
+    return false;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, uaddr);
+  success = p != NULL && p->writable && p->kpage != NULL
+            && page_break_cow (t, p);
+  lock_release (&t->pages_lock);
+  return success;
+}
+
+/* Copies the address space of PARENT into the running process,
+   whose supplemental page table and page directory must be
+   empty.  PARENT must not run until this function returns.
+
+   Pages that PARENT has not yet loaded are copied as
+   descriptions, to be loaded separately by each process.
+   Loaded read-only file pages are shared as usual.  All other
+   loaded pages are mapped read-only in both processes and
+   shared copy-on-write; pages PARENT had swapped out are brought
+   back in first so they can be shared too.  Memory-mapped files
+   are not inherited.  Returns true if successful, false if
+   memory is exhausted. */
+bool
+page_table_copy (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
+
+  lock_acquire (&parent->pages_lock);
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *c;
+
+      if (p->mapped)
+        continue;
+      if (p->kpage == NULL && p->swap_slot != SWAP_NONE)
+        {
+          if (!page_load (parent, p))
+            {
+              success = false;
+              break;
+            }
+          frame_unpin (p->kpage);
+        }
+
+      c = kmem_cache_alloc (page_cache);
+      if (c == NULL)
+        {
+          success = false;
+          break;
+        }
+      *c = *p;
+      if (p->file != NULL && p->file == parent->executable)
+        c->file = cur->executable;
+      c->kpage = NULL;
+
+      if (p->kpage != NULL)
+        {
+          if (p->shared)
+            c->kpage = share_get (c->file, c->ofs, c->read_bytes);
+          else
+            {
+              if (p->writable && !p->cow)
+                {
+                  p->dirty = p->dirty || pagedir_is_dirty (parent->pagedir,
+                                                           p->upage);
+                  pagedir_set_writable (parent->pagedir, p->upage, false);
+                  p->cow = true;
+                }
+              frame_share (p->kpage);
+              c->kpage = p->kpage;
+              c->cow = p->cow;
+              c->dirty = p->dirty;
+              fork_cnt++;
+            }
+          if (c->kpage == NULL
+              || !pagedir_set_page (cur->pagedir, c->upage, c->kpage, false))
+            {
+              if (c->kpage != NULL)
+                page_release (c, c->kpage);
+              kmem_cache_free (page_cache, c);
+              success = false;
+              break;
+            }
+        }
+
+      lock_acquire (&cur->pages_lock);
+      hash_insert (&cur->pages, &c->hash_elem);
+      lock_release (&cur->pages_lock);
+    }
+  lock_release (&parent->pages_lock);
+
+  return success;
+}
+
+/* Makes sure that the page containing user address UADDR in
+   process T is present in memory, loading it from its backing
+   store if necessary.  T need not be the running thread.
+   Returns true if the page is present afterward, false if UADDR
+   is not part of T's address space or cannot be loaded. */
+bool
+page_in (struct thread *t, const void *uaddr)
+{
+  struct page *p;
+  bool success;
+
+  if (!is_user_vaddr (uaddr))
+    return false;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, uaddr);
+  if (p == NULL)
+    success = false;
+  else if (p->kpage != NULL)
+    success = true;
+  else
+    {
+      success = page_load (t, p);
+      if (success && !p->shared)
+        frame_unpin (p->kpage);
+    }
+  lock_release (&t->pages_lock);
+  return success;
+}
+
+/* Brings in the page containing user address UADDR in process T,
+   like page_in(), and keeps it from being evicted until
+   page_unpin() is called, so that the kernel can access it
+   through its kernel alias.  If WRITE is true, the page must be
+   writable, and it is treated as modified.  Returns the kernel
+   address corresponding to UADDR, or a null pointer if UADDR is
+   not part of T's address space, is read-only and WRITE is true,
+   or cannot be loaded. */
+void *
+page_pin (struct thread *t, const void *uaddr, bool write)
+{
+  struct page *p;
+  void *kaddr = NULL;
+
+  if (!is_user_vaddr (uaddr))
+    return NULL;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, uaddr);
+  if (p != NULL && (p->writable || !write)
+      && (p->kpage != NULL || page_load (t, p))
+      && (!write || page_break_cow (t, p)))
+    {
+      if (!p->shared && !p->cow)
+        frame_pin (p->kpage);
+      if (write)
+        p->dirty = true;
+      kaddr = (uint8_t *) p->kpage + pg_ofs (uaddr);
+    }
+  lock_release (&t->pages_lock);
+  return kaddr;
+}
+
+/* Lets the page containing user address UADDR in process T,
+   pinned with page_pin(), be evicted again. */
+void
+page_unpin (struct thread *t, const void *uaddr)
+{
+  struct page *p;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, uaddr);
+  if (p != NULL && p->kpage != NULL && !p->shared && !p->cow)
+    frame_unpin (p->kpage);
+  lock_release (&t->pages_lock);
+}
+
+/* Prints paging statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Paging: %lld pages mapped lazily, %lld loaded on demand\n",
+          registered_cnt, loaded_cnt);
+  printf ("Fork: %lld frames shared, %lld copied on write\n",
+          fork_cnt, cow_cnt);
+}
+
+/* Returns a hash value for the page in hash element E. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  const struct page *pa = hash_entry (a, struct page, hash_elem);
+  const struct page *pb = hash_entry (b, struct page, hash_elem);
+  return pa->upage < pb->upage;
+}
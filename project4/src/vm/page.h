@@ -0,0 +1,62 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct thread;
+
+/* A user virtual page in a process's supplemental page table.
+   Records where the page's contents come from, so that it can
+   be brought into memory on its first access instead of when
+   the process is loaded, and brought back after eviction.  A
+   page that has been modified is evicted to swap, or written
+   back to its file if it is memory-mapped; a clean page is
+   simply dropped and read again from its file or zeroed. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    bool writable;              /* Mapped read/write? */
+    void *kpage;                /* Kernel address of frame, if loaded. */
+    bool shared;                /* Frame shared through vm/share? */
+    bool cow;                   /* Shared copy-on-write after fork? */
+    bool dirty;                 /* Contents differ from FILE? */
+    size_t swap_slot;           /* Swap slot holding page, if any. */
+
+    /* Backing store. */
+    struct file *file;          /* File to read from, or null. */
+    off_t ofs;                  /* Offset of page in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+    bool mapped;                /* Written back to FILE, not swap? */
+
+    struct hash_elem hash_elem; /* Element in thread's `pages'. */
+  };
+
+/* Maximum size of a user stack, in pages. */
+extern size_t stack_page_limit;
+
+void page_init (void);
+bool page_table_init (struct thread *);
+void page_table_destroy (struct thread *);
+
+bool page_add_file (struct file *, off_t ofs, void *upage,
+                    size_t read_bytes, bool writable);
+bool page_add_mmap (struct file *, off_t ofs, void *upage,
+                    size_t read_bytes);
+void page_remove (void *upage);
+bool page_grow_stack (const void *uaddr, const void *esp);
+bool page_in (struct thread *, const void *uaddr);
+void *page_pin (struct thread *, const void *uaddr, bool write);
+void page_unpin (struct thread *, const void *uaddr);
+void page_evict (struct thread *, struct page *);
+bool page_copy_on_write (struct thread *, const void *uaddr);
+bool page_table_copy (struct thread *parent);
+bool page_read_file (struct file *, off_t ofs, void *kpage,
+                     size_t read_bytes);
+
+void page_print_stats (void);
+
+#endif /* vm/page.h */
@@ -0,0 +1,171 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* A read-only page of file data that is mapped by one or more
+   processes.
+
+   Processes that run the same executable map its code and other
+   read-only segments from the same file pages, so there is no
+   need for each of them to have a private copy.  Writes to an
+   executable are denied while it is running, so the cached
+   contents cannot go stale while any process maps them.
+
+   Entries are keyed by inode rather than by file, because each
+   process opens its executable separately.  The inode stays in
+   memory as long as some process that maps one of its pages has
+   the executable open, and every such process drops its
+   references before it closes the executable.
+
+   Shared frames are never evicted. */
+struct shared_page
+  {
+    struct inode *inode;        /* Inode the data comes from. */
+    off_t ofs;                  /* Offset of the data in INODE. */
+    size_t read_bytes;          /* Bytes of file data; rest is zero. */
+    void *kpage;                /* Frame holding the data. */
+    int ref_cnt;                /* Number of mappings of KPAGE. */
+    struct hash_elem hash_elem; /* Element in `shared_pages'. */
+  };
+
+/* All shared pages, keyed by inode and offset. */
+static struct hash shared_pages;
+static struct lock share_lock;
+
+/* Statistics. */
+static long long shared_cnt;    /* # of mappings satisfied by sharing. */
+
+static hash_hash_func shared_page_hash;
+static hash_less_func shared_page_less;
+
+/* Initializes the shared page cache. */
+void
+share_init (void)
+{
+  hash_init (&shared_pages, shared_page_hash, shared_page_less, NULL);
+  lock_init (&share_lock);
+}
+
+/* Returns the shared page for READ_BYTES bytes of FILE at OFS,
+   or a null pointer if none exists.  share_lock must be held. */
+static struct shared_page *
+shared_page_lookup (struct file *file, off_t ofs, size_t read_bytes)
+{
+  struct shared_page sp;
+  struct hash_elem *e;
+
+  sp.inode = file_get_inode (file);
+  sp.ofs = ofs;
+  sp.read_bytes = read_bytes;
+  e = hash_find (&shared_pages, &sp.hash_elem);
+  return e != NULL ? hash_entry (e, struct shared_page, hash_elem) : NULL;
+}
+
+/* Returns a frame holding READ_BYTES bytes read from FILE at
+   offset OFS, followed by zeroes, for mapping read-only.  If
+   another process already maps the same data, its frame is
+   reused; otherwise a new frame is read in.  Each successful
+   call must be balanced by a call to share_put().  Returns a
+   null pointer if memory is exhausted or the read fails. */
+void *
+share_get (struct file *file, off_t ofs, size_t read_bytes)
+{
+  struct shared_page *sp;
+  void *kpage = NULL;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  lock_acquire (&share_lock);
+  sp = shared_page_lookup (file, ofs, read_bytes);
+  if (sp != NULL)
+    {
+      sp->ref_cnt++;
+      shared_cnt++;
+      kpage = sp->kpage;
+    }
+  else
+    {
+      sp = malloc (sizeof *sp);
+      kpage = frame_alloc (NULL, NULL);
+      if (sp != NULL && kpage != NULL
+          && page_read_file (file, ofs, kpage, read_bytes))
+        {
+          sp->inode = file_get_inode (file);
+          sp->ofs = ofs;
+          sp->read_bytes = read_bytes;
+          sp->kpage = kpage;
+          sp->ref_cnt = 1;
+          hash_insert (&shared_pages, &sp->hash_elem);
+        }
+      else
+        {
+          if (kpage != NULL)
+            frame_free (kpage);
+          free (sp);
+          kpage = NULL;
+        }
+    }
+  lock_release (&share_lock);
+
+  return kpage;
+}
+
+/* Drops a reference obtained from share_get() with the same
+   arguments, freeing the frame once no process maps it. */
+void
+share_put (struct file *file, off_t ofs, size_t read_bytes)
+{
+  struct shared_page *sp;
+
+  lock_acquire (&share_lock);
+  sp = shared_page_lookup (file, ofs, read_bytes);
+  ASSERT (sp != NULL);
+  if (--sp->ref_cnt == 0)
+    {
+      hash_delete (&shared_pages, &sp->hash_elem);
+      frame_free (sp->kpage);
+      free (sp);
+    }
+  lock_release (&share_lock);
+}
+
+/* Prints shared page statistics. */
+void
+share_print_stats (void)
+{
+  printf ("Sharing: %lld read-only pages mapped from another process\n",
+          shared_cnt);
+}
+
+/* Returns a hash value for the shared page in hash element E. */
+static unsigned
+shared_page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct shared_page *sp = hash_entry (e, struct shared_page,
+                                             hash_elem);
+  return hash_bytes (&sp->inode, sizeof sp->inode) ^ hash_int (sp->ofs);
+}
+
+/* Returns true if shared page A precedes shared page B. */
+static bool
+shared_page_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  const struct shared_page *sa = hash_entry (a, struct shared_page,
+                                             hash_elem);
+  const struct shared_page *sb = hash_entry (b, struct shared_page,
+                                             hash_elem);
+  if (sa->inode != sb->inode)
+    return sa->inode < sb->inode;
+  else if (sa->ofs != sb->ofs)
+    return sa->ofs < sb->ofs;
+  else
+    return sa->read_bytes < sb->read_bytes;
+}
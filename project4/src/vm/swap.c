@@ -0,0 +1,90 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in a page-sized swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Swap device and its slots.  A set bit marks a slot in use. */
+static struct block *swap_device;
+static struct bitmap *swap_slots;
+static struct lock swap_lock;
+
+/* Statistics. */
+static long long out_cnt;       /* # of pages written to swap. */
+static long long in_cnt;        /* # of pages read from swap. */
+
+/* Initializes swap.  Without a swap device, pages that must be
+   swapped out cannot be evicted. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SECTORS_PER_SLOT;
+  else
+    printf ("swap: no swap device\n");
+
+  swap_slots = bitmap_create (slot_cnt);
+  if (swap_slots == NULL)
+    PANIC ("out of memory allocating swap slots");
+  lock_init (&swap_lock);
+}
+
+/* Writes page KPAGE to a free swap slot and returns the slot.
+   Panics if swap is full. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot;
+  size_t i;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_slots, 0, 1, false);
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    PANIC ("out of swap space");
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  out_cnt++;
+  return slot;
+}
+
+/* Reads swap slot SLOT into page KPAGE and frees the slot. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  in_cnt++;
+  swap_free (slot);
+}
+
+/* Frees swap slot SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_slots, slot));
+  bitmap_reset (swap_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages swapped out, %lld swapped in\n",
+          out_cnt, in_cnt);
+}